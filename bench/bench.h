@@ -0,0 +1,70 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#define _POSIX_C_SOURCE 199309L /* clock_gettime */
+
+#include <stdio.h>
+#include <time.h>
+
+#include "../gc.h"
+
+/* monotonic time in seconds */
+static inline double bench_now(void) {
+     struct timespec ts;
+     clock_gettime(CLOCK_MONOTONIC,&ts);
+     return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* deterministic pseudo random numbers, so every run does the same work */
+static unsigned long bench_seed = 12345;
+static inline unsigned long bench_random(void) {
+     bench_seed = bench_seed * 6364136223846793005UL + 1442695040888963407UL;
+     return bench_seed >> 33;
+}
+
+/* pause time in microseconds below which a fraction of all pauses
+ * fall, from the histogram of gc_stats. Pauses are assumed to spread
+ * evenly over their power-of-two bucket, and no estimate exceeds the
+ * longest pause, so the result is within the bucket of the true value
+ * rather than at its upper bound. */
+static inline double bench_pause_quantile(struct gc_stats* stats, double fraction) {
+     unsigned long total = 0, seen = 0;
+     int i;
+     for (i = 0; i < GC_PAUSE_BUCKETS; i++)
+          total += stats->pauses[i];
+     if (!total)
+          return -1;
+
+     double rank = fraction * total;
+     for (i = 0; i < GC_PAUSE_BUCKETS - 1; i++) {
+          if (seen + stats->pauses[i] >= rank && stats->pauses[i])
+               break;
+          seen += stats->pauses[i];
+     }
+     /* bucket 0 holds [0,1), bucket i [2^(i-1),2^i) microseconds */
+     double low = i ? (double)(1UL << (i - 1)) : 0;
+     double high = (double)(1UL << i);
+     double within = (rank - seen) / stats->pauses[i];
+     double us = low + (within > 0 ? within : 0) * (high - low);
+     double max = stats->max_pause_ns / 1e3;
+     return us < max ? us : max;
+}
+
+/* print the results of a benchmark as a single line of JSON */
+static inline void bench_report(const char* name, GarbageCollector gc, unsigned long allocs, double start) {
+     double seconds = bench_now() - start;
+     struct gc_stats stats;
+     gc_stats(gc,&stats);
+
+     printf("{\"bench\": \"%s\", \"allocs\": %lu, \"seconds\": %.3f, "
+            "\"allocs_per_sec\": %.0f, \"collections\": %lu, "
+            "\"gc_ms\": %.3f, \"mark_ms\": %.3f, \"sweep_ms\": %.3f, "
+            "\"max_pause_us\": %.1f, \"p99_pause_us\": %.0f, "
+            "\"heap_bytes\": %lu}\n",
+            name,allocs,seconds,allocs / seconds,stats.collections,
+            (stats.mark_ns + stats.sweep_ns) / 1e6,stats.mark_ns / 1e6,stats.sweep_ns / 1e6,
+            stats.max_pause_ns / 1e3,bench_pause_quantile(&stats,0.99),
+            (unsigned long)stats.heap_bytes);
+}
+
+#endif
@@ -0,0 +1,63 @@
+#include "bench.h"
+
+/* binary-trees: many short-lived trees of increasing depth next to a
+ * long-lived one */
+
+#define MIN_DEPTH 4
+#define MAX_DEPTH 16
+
+typedef struct tree * Tree;
+struct tree {
+     Tree left;
+     Tree right;
+};
+
+static void mark_tree(void* object) {
+     gc_mark(mark_tree,((Tree)object)->left);
+     gc_mark(mark_tree,((Tree)object)->right);
+}
+
+static unsigned long allocs;
+
+static Tree make(GarbageCollector gc, int depth) {
+     Tree t = gc_alloc(gc);
+     t->left = t->right = NULL;
+     allocs++;
+
+     if (depth > 0) {
+          gc_protect(gc,(void**)&t);
+          t->left = make(gc,depth - 1);
+          t->right = make(gc,depth - 1);
+          gc_expose(gc,1);
+     }
+     return t;
+}
+
+static long check(Tree t) {
+     return t->left ? 1 + check(t->left) + check(t->right) : 1;
+}
+
+int main(void) {
+     GarbageCollector gc = gc_create(0,sizeof(struct tree),mark_tree,NULL,NULL);
+     gc_set_growth(gc,0.5,4 * 1024 * 1024,0);
+     double start = bench_now();
+     long checksum = 0;
+     int depth, i;
+
+     checksum += check(make(gc,MAX_DEPTH + 1));
+
+     Tree long_lived = make(gc,MAX_DEPTH);
+     gc_root(gc,long_lived);
+
+     for (depth = MIN_DEPTH; depth <= MAX_DEPTH; depth += 2) {
+          int iterations = 1 << (MAX_DEPTH - depth + MIN_DEPTH);
+          for (i = 0; i < iterations; i++)
+               checksum += check(make(gc,depth));
+     }
+     checksum += check(long_lived);
+
+     bench_report("binary_trees",gc,allocs,start);
+     gc_free(&gc);
+
+     return checksum > 0 ? 0 : 1;
+}
@@ -0,0 +1,48 @@
+#include "bench.h"
+
+/* list churn: a list of fixed length whose nodes are constantly
+ * replaced, in the style of example2.c */
+
+#define LENGTH 10000
+#define ALLOCS 5000000
+
+typedef struct node * Node;
+struct node {
+     int value;
+     Node next;
+};
+
+static void mark_node(void* object) {
+     gc_mark(mark_node,((Node)object)->next);
+}
+
+int main(void) {
+     GarbageCollector gc = gc_create(4 * LENGTH,sizeof(struct node),mark_node,NULL,NULL);
+     double start = bench_now();
+     Node head = NULL;
+     unsigned long i;
+     int length = 0, j;
+
+     gc_protect(gc,(void**)&head);
+     for (i = 0; i < ALLOCS; i++) {
+          Node n = gc_alloc(gc);
+          n->value = (int)i;
+          n->next = head;
+          head = n;
+
+          /* cut off a random part of the tail once it is too long */
+          if (++length == LENGTH) {
+               Node cur = head;
+               length = LENGTH / 2 + (int)(bench_random() % (LENGTH / 2));
+               for (j = 1; j < length; j++)
+                    cur = cur->next;
+               cur->next = NULL;
+          }
+     }
+
+     bench_report("list_churn",gc,ALLOCS,start);
+     gc_expose(gc,1);
+     gc_free(&gc);
+
+     return 0;
+}
@@ -0,0 +1,56 @@
+#include "bench.h"
+
+/* a large long-lived structure next to a stream of short-lived
+ * objects, some of which get attached to the long-lived part */
+
+#define LONG_LIVED 200000
+#define ALLOCS 5000000
+
+typedef struct node * Node;
+struct node {
+     Node next;
+     Node other;
+};
+
+static void mark_node(void* object) {
+     gc_mark(mark_node,((Node)object)->next);
+     gc_mark(mark_node,((Node)object)->other);
+}
+
+static Node node(GarbageCollector gc, Node next) {
+     Node n = gc_alloc(gc);
+     n->next = next;
+     n->other = NULL;
+     return n;
+}
+
+int main(void) {
+     GarbageCollector gc = gc_create(0,sizeof(struct node),mark_node,NULL,NULL);
+     gc_set_growth(gc,0.5,4 * 1024 * 1024,0);
+     static Node nodes[LONG_LIVED];
+     Node list = NULL, young = NULL;
+     double start = bench_now();
+     unsigned long i;
+
+     gc_protect(gc,(void**)&list);
+     for (i = 0; i < LONG_LIVED; i++)
+          nodes[i] = list = node(gc,list);
+
+     gc_protect(gc,(void**)&young);
+     for (i = 0; i < ALLOCS; i++) {
+          young = node(gc,young);
+          if (i % 64 == 0) /* drop the short-lived ones */
+               young->next = NULL;
+          if (i % 1024 == 0) { /* and keep one of them now and then */
+               Node old = nodes[bench_random() % LONG_LIVED];
+               gc_write_barrier(old,young);
+               old->other = young;
+          }
+     }
+
+     bench_report("mixed",gc,LONG_LIVED + ALLOCS,start);
+     gc_expose(gc,2);
+     gc_free(&gc);
+
+     return 0;
+}
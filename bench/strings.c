@@ -0,0 +1,35 @@
+#include "bench.h"
+
+#include <string.h>
+
+/* strings of many sizes in a single collector, in the style of
+ * example3.c: a window of recent strings stays alive, with the odd
+ * large buffer among them */
+
+#define LIVE 4096
+#define ALLOCS 2000000
+
+int main(void) {
+     GarbageCollector gc = gc_create(0,0,NULL,NULL,NULL);
+     static char* live[LIVE];
+     double start = bench_now();
+     unsigned long i;
+
+     gc_protect_frame(gc,(void**)live,LIVE);
+     for (i = 0; i < ALLOCS; i++) {
+          size_t n = 8 + bench_random() % 200;
+          if (bench_random() % 1000 == 0)
+               n = 16 * 1024 + bench_random() % (16 * 1024);
+
+          char* s = gc_alloc_size(gc,n);
+          memset(s,'x',n - 1);
+          s[n - 1] = '\0';
+          live[bench_random() % LIVE] = s;
+     }
+
+     bench_report("strings",gc,ALLOCS,start);
+     gc_expose(gc,1);
+     gc_free(&gc);
+
+     return 0;
+}
@@ -51,10 +51,6 @@ String string(GarbageCollector gc, char* data) {
           return NULL;
 
      String str = gc_alloc(gc);
-     if (!str) { /* ran out of objects */
-          gc_add(gc,1); /* let the garbage collector manage one more object */
-          str = gc_alloc(gc);
-     }
      str->len = strlen(data);
      str->data = malloc(str->len + 1); /* + 1 for null byte */
      strcpy(str->data,data); /* also copies the null byte from source */
@@ -78,10 +74,6 @@ String string_concat(GarbageCollector gc, String a, String b) {
      strcat(buf,b->data);
 
      String result = gc_alloc(gc);
-     if (!result) {      /* ran out of objects */
-          gc_add(gc,1);  /* let the garbage collector manage one more object */
-          result = gc_alloc(gc);
-     }
      result->data = buf;
      result->len = buflen;
 
@@ -95,6 +87,10 @@ int main(int argc, char** argv) {
                                             string_free, /* on collect */
                                             string_free); /* on destroy */
 
+     /* grow the heap when running out of strings, so that a third of it
+        is in use after collecting */
+     gc_set_growth(string_gc,0.33,0,0);
+
      String result = NULL;
 
      /* protect whatever result is pointing to */
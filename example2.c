@@ -27,6 +27,7 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 #include "gc.h"
+#include <stddef.h>
 #include <stdio.h>
 
 /* list of numbers */
@@ -36,16 +37,6 @@ struct node {
      Node next;
 };
 
-/* when marking a list node also mark it's successors */
-void node_mark(void* object) {
-     if (!object)
-          return;
-
-     Node n = (Node)object;
-     
-     gc_mark(node_mark,n->next);
-}
-
 /* create a new list node */
 Node node(GarbageCollector gc, Node next, int value) {
      if (!gc)
@@ -62,7 +53,11 @@ Node node(GarbageCollector gc, Node next, int value) {
 }
 
 int main(int argc, char** argv) {
-     GarbageCollector gc = gc_create(10,sizeof(struct node),node_mark,NULL,NULL);
+     GarbageCollector gc = gc_create(10,sizeof(struct node),NULL,NULL,NULL);
+
+     /* the collector marks the successor of a node by itself */
+     static const size_t references[] = { offsetof(struct node,next) };
+     gc_set_layout(gc,references,1);
 
      Node head = NULL;
      gc_protect(gc,&head); /* protect the list from garbage collection */
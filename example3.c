@@ -31,55 +31,32 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stdlib.h>
 #include <string.h>
 
+static GarbageCollector gc;
+
 /*
- * returns managed memory by instantiating a garbage collector for each
- * request memory size.
+ * returns managed memory of the requested size. All sizes share a
+ * single garbage collector.
  *
- * frees all garbage collector if size equals 0
+ * frees the garbage collector if size equals 0
  *
  * puts the newly allocated object into the root set if root equals
  * non-zero
  */
 
 void* gc_malloc(size_t size, int root) {
-     struct GCNode {
-          size_t size;
-          GarbageCollector gc;
-          struct GCNode* next;
-     } * gc_head = NULL;
-
-     struct GCNode * cur = NULL;
-     struct GCNode * next = NULL;
-     
-     /* if size == 0 free all garbage collectors */
+     /* if size == 0 free the garbage collector */
      if (size == 0) {
-          for (cur = gc_head; cur ; cur = next) {
-               next = cur->next;
-               gc_free(&(cur->gc));
-               free(cur);
-          }
-          gc_head = NULL; /* avoid having a dangling pointer */
-     }
-     
-     /* check whether there is a fitting garbage collector already */
-     for (cur = gc_head; cur ; cur = cur->next)
-          if (cur->size == size)
-               break;
-
-     /* create a new garbage collector if necessary */
-     if (cur == NULL) {
-          cur = malloc(sizeof(*cur));
-
-          cur->size = size;
-          cur->gc   = gc_create(1024,size,NULL,NULL,NULL);
-          cur->next = gc_head;
-          gc_head = cur;
+          gc_free(&gc);
+          return NULL;
      }
 
-     void* result = gc_alloc(cur->gc);
+     if (gc == NULL)
+          gc = gc_create(0,0,NULL,NULL,NULL);
+
+     void* result = gc_alloc_size(gc,size);
 
      if (root)
-          gc_root(cur->gc,result);
+          gc_root(gc,result);
 
      return result;
 }
@@ -26,12 +26,46 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
+#define _DEFAULT_SOURCE /* MAP_ANONYMOUS */
+#define _GNU_SOURCE /* pthread_getattr_np */
 #include "gc.h"
 
+#include <setjmp.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#if defined(__GLIBC__) || defined(__APPLE__)
+#include <execinfo.h>
+#define HAVE_BACKTRACE
+#endif
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/* stacks are scanned word by word, including memory the address
+   sanitizer considers off limits */
+#if defined(__GNUC__) && defined(__has_attribute)
+#if __has_attribute(no_sanitize_address)
+#define NO_SANITIZE_ADDRESS __attribute__((no_sanitize_address))
+#endif
+#endif
+#ifndef NO_SANITIZE_ADDRESS
+#define NO_SANITIZE_ADDRESS
+#endif
 
 static void* xmalloc(size_t n) {
      void* result = malloc(n);
@@ -44,262 +78,3540 @@ static void* xmalloc(size_t n) {
      return result;
 }
 
-/* header for each object */
-typedef struct node * Node;
-struct node {
-     Node next; /* TODO: collapse both fields into one using pointer masking */
-     char mark;
-};
+static void* xrealloc(void* p, size_t n) {
+     void* result = realloc(p,n);
+     if (!result) {
+          fputs("gc: out of memory.\n",stderr);
+          abort();
+     }
+
+     return result;
+}
+
+/* monotonic time in nanoseconds */
+static unsigned long long now_ns(void) {
+     struct timespec ts;
+     clock_gettime(CLOCK_MONOTONIC,&ts);
+     return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
 
-static Node node(size_t size, Node next) {
-     Node n = xmalloc(size + sizeof *n); /* header + object size */
+/* round n up to the next multiple of align */
+static inline size_t align_up(size_t n, size_t align) {
+     return (n + align - 1) / align * align;
+}
+
+/* bitmap word helpers */
+static inline size_t ctz64(uint64_t w) {
+#ifdef __GNUC__
+     return (size_t)__builtin_ctzll(w);
+#else
+     size_t n = 0;
+     while (!(w & 1)) { w >>= 1; n++; }
+     return n;
+#endif
+}
 
-     n->next = next;
-     n->mark = 0;
+/* index of the highest set bit, w must not be zero */
+static inline size_t log2_floor(size_t w) {
+#ifdef __GNUC__
+     return (size_t)(63 - __builtin_clzll((unsigned long long)w));
+#else
+     size_t n = 0;
+     while (w >>= 1) n++;
+     return n;
+#endif
+}
 
+static inline size_t popcount64(uint64_t w) {
+#ifdef __GNUC__
+     return (size_t)__builtin_popcountll(w);
+#else
+     size_t n = 0;
+     for (; w; w &= w - 1) n++;
      return n;
+#endif
 }
 
-/* list node for rooted/protected objects */
-typedef struct root * Root;
-struct root {
-     Root next;
-     void* data;
+/* kinds of per-slab side bitmaps, one bit per object */
+enum {
+     MARK_BITS,  /* object is reachable */
+     ALLOC_BITS, /* object has been handed out by gc_alloc */
+     REMEMBERED_BITS, /* old object is in the remembered set */
+     PINNED_BITS, /* object must not be moved, see gc_pin */
+     HELD_BITS,  /* object is referenced by value while compacting */
+     QUEUED_BITS, /* dead object is waiting for finalization */
+     FINALIZED_BITS, /* queued object has been finalized */
+     NBITMAPS
+};
+
+/* backing obtained for the memory of a slab, see gc_set_backing */
+enum {
+     BACKED_HUGE = 1,        /* explicit huge pages */
+     BACKED_TRANSPARENT = 2, /* advised to use transparent huge pages */
+     BACKED_BOUND = 4        /* bound to or interleaved across NUMA nodes */
+};
+
+/* sweep states of a slab */
+enum {
+     SWEPT,      /* free objects can be handed out */
+     UNSWEPT,    /* marked, but not swept yet (lazy or background sweeping) */
+     SWEEPING    /* being swept by another thread */
+};
+
+/* a slab is a block of memory holding many objects of the same size,
+ * aligned to GC_SLAB_ALIGN so that the slab of an object is found by
+ * masking its address. Objects are packed without any header; all
+ * management information lives in side bitmaps behind the slab
+ * header. Objects are carved from a slab on demand, so a slab can be
+ * only partially in use. */
+typedef struct mutator * Mutator;
+typedef struct slab * Slab;
+struct slab {
+     Slab next;        /* next slab in the heap */
+     Slab sibling;     /* next slab of the same size class */
+     GarbageCollector gc; /* collector owning this slab */
+     Mutator owner;    /* thread allocating from this slab, if any */
+     size_t nfree;     /* number of carved objects not allocated */
+     size_t nobjects;  /* number of objects carved so far */
+     size_t capacity;  /* number of objects fitting in this slab */
+     size_t stride;    /* distance between two objects */
+     size_t bytes;     /* size of the mapping */
+     size_t nwords;    /* words per bitmap */
+     size_t cursor;    /* first bitmap word that may have free objects */
+     int unswept;      /* sweep state, see above */
+     int young;        /* has objects allocated since the last collection */
+     int evacuating;   /* objects are being moved out of this slab */
+     int fixed;        /* holds objects of gc_alloc */
+     unsigned empty;   /* number of sweeps in a row that found no objects */
+     size_t released;  /* bytes of object pages given back to the system */
+     size_t marked;    /* objects marked when last counted, see count_live */
+     int backing;      /* backing of the mapping, see above */
+     int chunked;      /* lives in a slot of a chunk, see map_slot */
+     char* objects;    /* address of the first object */
+     uint64_t* bits;   /* NBITMAPS bitmaps of nwords words each */
+};
+
+#define GC_SLAB_ALIGN ((size_t)2 * 1024 * 1024)
+
+/* slots of GC_SLAB_ALIGN bytes mapped at once for slabs, see map_slot */
+#define CHUNK_SLOTS 32
+
+/* default policy for giving memory back, see gc_set_release */
+#define DEFAULT_RELEASE_CYCLES 2
+
+/* default heap policy of gc_alloc_size, see gc_set_growth */
+#define DEFAULT_OCCUPANCY 0.5
+#define DEFAULT_MIN_HEAP ((size_t)1024 * 1024)
+
+/* number of objects finalized by a call of on_collect_batch */
+#define FINALIZE_BATCH 256
+
+/* NUMA nodes gc_set_backing can bind slabs to */
+#define MAX_NODES 1024
+#define NODE_WORDS (MAX_NODES / (8 * sizeof(unsigned long)))
+
+/* memory policies of mbind and flags of get_mempolicy, as in <numaif.h> */
+#define POLICY_BIND 2
+#define POLICY_INTERLEAVE 3
+#define MEMS_ALLOWED 4
+
+/* frames recorded for a sampled allocation, and frames of the
+ * collector itself that may precede them */
+#define MAX_FRAMES 64
+#define SKIPPED_FRAMES 8
+
+/* return address of the calling function */
+#ifdef __GNUC__
+#define CALLER() __builtin_return_address(0)
+#else
+#define CALLER() NULL
+#endif
+
+/* end of the list of unused root handles */
+#define NO_HANDLE ((size_t)-1)
+
+/* size classes: the objects of gc_alloc, the built-in sizes of
+ * gc_alloc_size and objects too large for those, one per slab */
+#define NSIZES 36
+#define MAX_CLASS_SIZE 8192
+#define FIXED 0
+#define LARGE (NSIZES + 1)
+#define NCLASSES (NSIZES + 2)
+
+/* slabs holding objects of a single size */
+typedef struct sizeclass * SizeClass;
+struct sizeclass {
+     Slab first;       /* first slab of this size */
+     Slab last;        /* last slab, objects are carved from here */
+     Slab current;     /* next slab to hand out to a thread */
+     size_t stride;    /* distance between two objects, 0 for LARGE */
 };
 
-static Root root(Root next, void* data) {
-     Root r = xmalloc(sizeof *r);
+/* built-in size class of objects of n bytes, n <= MAX_CLASS_SIZE:
+ * multiples of 8 bytes up to 64, then four classes per power of two,
+ * so no object wastes more than a fifth of its slot */
+static inline size_t size_class(size_t n) {
+     if (n <= 64)
+          return n ? (n - 1) / 8 : 0;
+     size_t b = log2_floor(n - 1);
+     return 8 + (b - 6) * 4 + ((n - 1) >> (b - 2)) - 4;
+}
+
+static inline size_t class_size(size_t i) {
+     if (i < 8)
+          return 8 * (i + 1);
+     return (5 + (i - 8) % 4) << (6 + (i - 8) / 4 - 2);
+}
+
+static size_t page_size(void) {
+     static size_t size;
+     if (!size) {
+          long n = sysconf(_SC_PAGESIZE);
+          size = n > 0 ? (size_t)n : 4096;
+     }
+     return size;
+}
+
+/* give a mapping back to the system. Failing to do so leaves the
+ * address space in a state the collector does not know, so it is
+ * fatal like running out of memory. */
+static void unmap(void* mem, size_t bytes) {
+     if (munmap(mem,bytes) != 0) {
+          perror("gc: munmap");
+          abort();
+     }
+}
+
+/* map bytes aligned to GC_SLAB_ALIGN with the given protection and
+ * mmap flags, or return NULL if the system has no room for them */
+static void* map_aligned_as(size_t bytes, int prot, int flags) {
+     char* mem = mmap(NULL, bytes + GC_SLAB_ALIGN, prot,
+                      MAP_PRIVATE | MAP_ANONYMOUS | flags,
+                      -1, 0);
+     if (mem == MAP_FAILED)
+          return NULL;
+
+     /* trim the excess in front of and behind the aligned block */
+     char* start = (char*)align_up((size_t)mem,GC_SLAB_ALIGN);
+     if (start > mem)
+          unmap(mem,(size_t)(start - mem));
+     unmap(start + bytes,(size_t)(mem + GC_SLAB_ALIGN - start));
+
+     return start;
+}
+
+/* map bytes of zero-filled memory aligned to GC_SLAB_ALIGN, or return
+ * NULL if the system has no room for them */
+static void* map_aligned(size_t bytes) {
+     return map_aligned_as(bytes,PROT_READ | PROT_WRITE,0);
+}
+
+/* size of the slab header plus bitmaps for capacity objects */
+static inline size_t slab_header(size_t capacity) {
+     size_t nwords = (capacity + 63) / 64;
+     return align_up(sizeof(struct slab) + NBITMAPS * nwords * sizeof(uint64_t),
+                     2 * sizeof(void*));
+}
+
+/* number of objects of the given stride fitting into a slab of bytes */
+static size_t slab_capacity(size_t bytes, size_t stride) {
+     size_t capacity = bytes / stride;
+     while (capacity > 0 && slab_header(capacity) + capacity * stride > bytes)
+          capacity--;
+     return capacity;
+}
+
+static inline uint64_t* bitmap(Slab s, int kind) {
+     return s->bits + kind * s->nwords;
+}
+
+static inline void* slab_object(Slab s, size_t i) {
+     return s->objects + i * s->stride;
+}
+
+/* find the slab of an object by masking its address */
+static inline Slab object_slab(void* object) {
+     return (Slab)((size_t)object & ~(GC_SLAB_ALIGN - 1));
+}
+
+static inline size_t object_index(Slab s, void* object) {
+     return (size_t)((char*)object - s->objects) / s->stride;
+}
+
+static inline int test_bit(Slab s, int kind, size_t i) {
+     return (bitmap(s,kind)[i / 64] >> (i % 64)) & 1;
+}
 
-     r->next = next;
-     r->data = data;
+static inline void set_bit(Slab s, int kind, size_t i) {
+     bitmap(s,kind)[i / 64] |= (uint64_t)1 << (i % 64);
+}
 
-     return r;
+static inline void clear_bit(Slab s, int kind, size_t i) {
+     bitmap(s,kind)[i / 64] &= ~((uint64_t)1 << (i % 64));
 }
 
+/* entry of the mark stack: an object whose references still have to
+ * be traced by calling cont on it */
+struct gray {
+     void* object;
+     gc_event_fn cont;
+};
+
+/* reference recorded by gc_mark_slot while compacting: a slot inside
+ * object, or a protected slot if object is NULL */
+struct slot_ref {
+     void* object;
+     void** slot;
+};
+
+/* weak reference: key does not keep its object alive, and value is
+ * only kept alive as long as key is. Both are cleared once key is
+ * collected. Unused entries are chained through next. */
+struct weak {
+     void* key;
+     void* value;
+     size_t next;
+};
+
+/* allocation site of the profiler: a distinct stack of sampled
+ * allocations, with the bytes they stand for */
+struct site {
+     void** frames;          /* return addresses, innermost first */
+     size_t nframes;         /* number of frames */
+     size_t hash;            /* hash of the frames */
+     unsigned long long allocated_bytes; /* bytes allocated from this site */
+     unsigned long long live_bytes; /* part of those still alive */
+};
+
+/* sampled object that has not been found dead yet */
+struct sample {
+     void* object;
+     size_t site;            /* index of its allocation site */
+     size_t bytes;           /* bytes the sample stands for */
+};
+
+/* entry of the shadow stack: n consecutive protected slots */
+struct frame {
+     void** slots;
+     size_t n;
+};
+
+/* mark stack of a parallel marking thread. Only its owner touches it,
+ * without locking; it hands part of it to the shared pool when other
+ * marking threads run out of work, see share_work. */
+typedef struct marker * Marker;
+struct marker {
+     GarbageCollector gc;    /* collector this thread is marking for */
+     pthread_t thread;       /* helper thread, unused for the first marker */
+     struct gray* stack;     /* objects to trace */
+     size_t nstack;          /* number of objects on the stack */
+     size_t stack_size;      /* capacity of the stack */
+     unsigned long cycle;    /* last marking cycle this thread took part in */
+};
+
+/* state of a single thread using a garbage collector */
+struct mutator {
+     Mutator next;           /* next attached thread */
+     Slab current[NCLASSES]; /* slabs this thread is allocating from */
+     struct frame* frames;   /* shadow stack of protected slots */
+     size_t nframes;         /* number of entries on the shadow stack */
+     size_t frames_size;     /* capacity of the shadow stack */
+     void** batch;           /* objects gc_alloc_n took before collecting */
+     size_t nbatch;          /* number of objects in batch */
+     void** finalizing;      /* queued objects gc_run_finalizers is finalizing */
+     size_t nfinalizing;     /* number of objects in finalizing */
+     char* stack_base;       /* end of the thread's stack, for conservative scanning */
+     char* stack_top;        /* lowest live stack address while parked */
+     size_t sample_left;     /* bytes to allocate until the next sample */
+     uint64_t sample_seed;   /* state of the sampling interval generator */
+};
+
 struct garbage_collector {
-     Node free;              /* list of free objects */
-     Node active;            /* list of used objects */
-     Root used_roots;        /* active root nodes */
-     Root free_roots;        /* free root nodes */
-     Root used_protected;    /* active protected nodes */
-     Root free_protected;    /* free protected nodes */
+     Slab slabs;             /* all slabs, in allocation order */
+     Slab last;              /* last slab of the heap */
+     struct sizeclass classes[NCLASSES]; /* slabs by object size */
+     size_t mapped;          /* bytes in all slabs */
+     size_t idle;            /* bytes in slabs whose memory is released */
+     Slab* ranges;           /* all slabs, by address once sorted */
+     size_t nranges;         /* number of slabs in ranges */
+     size_t ranges_size;     /* capacity of ranges */
+     size_t nsorted;         /* leading slabs of ranges known to be sorted */
+     char* heap_end;         /* end of the highest slab */
+     char** chunks;          /* mappings slabs are carved from, see map_slot */
+     size_t nchunks;         /* number of chunks */
+     size_t chunks_size;     /* capacity of chunks */
+     void** slots;           /* unused slots of the chunks */
+     size_t nslots;          /* number of unused slots */
+     size_t slots_size;      /* capacity of slots */
+     int pages;              /* kind of pages backing new slabs, see gc_set_backing */
+     int node;               /* NUMA placement of new slabs */
+     unsigned long nodes[NODE_WORDS]; /* nodes new slabs are bound to */
+     int conservative;       /* scan thread stacks for references */
+     int growing;            /* gc_alloc may grow the heap, too */
+     double occupancy;       /* fraction of the heap to be live after a collection */
+     size_t min_heap;        /* heap size up to which the heap grows without collecting */
+     size_t max_heap;        /* heap size the heap never grows beyond */
+     size_t threshold;       /* heap size at which to collect instead of growing */
+     size_t handed;          /* bytes of free objects handed to threads since the last collection */
+     size_t marked_objects;  /* sum of the marked counts of all slabs */
+     size_t marked_bytes;    /* bytes of those objects */
+     size_t retain;          /* heap size kept when giving memory back */
+     unsigned release_cycles; /* collections a slab stays empty before it is given back */
+     struct gc_stats stats;  /* counters reported by gc_stats */
+     unsigned long long pause_start; /* start of the current pause */
+     void** roots;           /* rooted objects, without holes */
+     size_t* root_handles;   /* handle of each rooted object */
+     size_t nroots;          /* number of rooted objects */
+     size_t roots_size;      /* capacity of roots and root_handles */
+     size_t* handles;        /* index into roots of each handle, or the next unused handle */
+     size_t nhandles;        /* number of handles created so far */
+     size_t handles_size;    /* capacity of handles */
+     size_t free_handle;     /* first unused handle, NO_HANDLE if none */
+     struct weak* weak;      /* weak references, indexed by handle */
+     size_t nweak;           /* number of weak handles created so far */
+     size_t weak_size;       /* capacity of weak */
+     size_t free_weak;       /* first unused weak handle, NO_HANDLE if none */
+     struct mutator main;    /* thread that created the collector */
+     Mutator mutators;       /* all attached threads */
      gc_event_fn on_mark;    /* callback when marking an object */
      gc_event_fn on_collect; /* callback when collecting an object */
      gc_event_fn on_destroy; /* callback when destroying an object */
+     gc_batch_fn on_collect_batch; /* callback when finalizing queued objects */
+     int deferred;           /* queue dead objects instead of calling on_collect */
+     int finalizers;         /* objects may be queued, see sweep */
+     size_t finalize_per_alloc; /* queued objects finalized when gc_alloc needs a slab */
+     pthread_mutex_t finalize_lock; /* protects the finalization queue */
+     void** finalize;        /* dead objects waiting for finalization */
+     size_t nfinalize;       /* number of objects in the queue */
+     size_t finalize_size;   /* capacity of the queue */
+     size_t sample_bytes;    /* average bytes between two samples, 0 if not profiling */
+     int profiled;           /* profile_lock is initialised */
+     pthread_mutex_t profile_lock; /* protects the fields below */
+     struct site* sites;     /* allocation sites of sampled objects */
+     size_t nsites;          /* number of sites */
+     size_t sites_size;      /* capacity of sites */
+     size_t* site_table;     /* hash table of sites, indexes plus one */
+     size_t site_table_size; /* number of entries in site_table, a power of two */
+     struct sample* samples; /* sampled objects still alive */
+     size_t nsamples;        /* number of samples */
+     size_t samples_size;    /* capacity of samples */
+     int by_layout;          /* objects of gc_alloc are traced by layout */
+     size_t* layout;         /* offsets of the references in objects of gc_alloc */
+     size_t nlayout;         /* number of offsets in layout */
      size_t size;            /* size of a single object */
+     size_t slab_size;       /* size of a single slab in bytes */
+     size_t chosen_slab_size; /* slab size of gc_create_slab, without huge pages */
+     struct gray* stack;     /* mark stack of objects left to trace */
+     size_t nstack;          /* number of entries on the mark stack */
+     size_t stack_size;      /* capacity of the mark stack */
+     void* tracing;          /* object whose references are being traced */
+     int compacting;         /* gc_compact is marking */
+     struct slot_ref* slot_refs; /* references to update after moving objects */
+     size_t nslot_refs;      /* number of recorded references */
+     size_t slot_refs_size;  /* capacity of slot_refs */
+     int lazy;               /* sweep slabs on demand in gc_alloc */
+     int marking;            /* an incremental mark is in progress */
+     int generational;       /* keep marks of survivors between cycles */
+     void** remembered;      /* old objects that were given young references */
+     size_t nremembered;     /* number of objects in the remembered set */
+     size_t remembered_size; /* capacity of the remembered set */
+     int threaded;           /* shared between several threads */
+     pthread_key_t self;     /* Mutator of the calling thread */
+     pthread_mutex_t lock;   /* protects slab hand-out, roots and thread list */
+     pthread_cond_t parked;  /* signalled when a thread reaches a safepoint */
+     pthread_cond_t resumed; /* signalled when a collection is finished */
+     int stop;               /* threads must stop at the next safepoint */
+     size_t nthreads;        /* number of attached threads */
+     size_t nparked;         /* number of threads stopped at a safepoint */
+     Marker markers;         /* parallel marking threads, the first is the collector */
+     size_t nmarkers;        /* number of marking threads, 0 or 1 for serial marking */
+     int parallel;           /* parallel marking is in progress */
+     pthread_mutex_t mark_lock; /* protects the fields below */
+     pthread_cond_t mark_start; /* signalled when a marking cycle starts */
+     pthread_cond_t mark_done;  /* signalled when a helper runs out of work */
+     pthread_cond_t mark_work;  /* signalled when work is added to the pool */
+     unsigned long mark_cycle;  /* number of parallel marking cycles */
+     struct gray* pool;      /* objects shared by marking threads */
+     size_t npool;           /* number of objects in the pool */
+     size_t pool_size;       /* capacity of the pool */
+     size_t nidle;           /* marking threads out of work */
+     size_t nwaiting;        /* idle marking threads waiting on mark_work */
+     size_t nfinished;       /* helpers done with the current cycle */
+     int quit;               /* helper threads must exit */
+     int background;         /* sweep in a background thread */
+     pthread_t sweeper;      /* background sweeping thread */
+     pthread_mutex_t sweep_lock; /* protects sweep states and the fields below */
+     pthread_cond_t sweep_start; /* signalled when slabs are left to sweep */
+     pthread_cond_t swept;   /* signalled when a slab has been swept */
+     unsigned long sweep_cycle; /* number of sweeps handed to the sweeper */
+     Slab sweep_end;         /* last slab of the heap at the latest collection */
+     int sweep_quit;         /* sweeping thread must exit */
 };
 
+static inline Mutator self(GarbageCollector gc) {
+     return gc->threaded ? pthread_getspecific(gc->self) : &gc->main;
+}
+
+static inline void lock(GarbageCollector gc) {
+     if (gc->threaded)
+          pthread_mutex_lock(&gc->lock);
+}
+
+static inline void unlock(GarbageCollector gc) {
+     if (gc->threaded)
+          pthread_mutex_unlock(&gc->lock);
+}
+
+/* objects are aligned to the smaller of their size, rounded up to a
+ * power of two, and the size of a pointer */
+static size_t object_stride(size_t size) {
+     size_t align = 1;
+     while (align < size && align < sizeof(void*))
+          align *= 2;
+     return size ? align_up(size,align) : 1;
+}
+
 GarbageCollector gc_create(size_t nobjects,
                            size_t size,
                            gc_event_fn on_mark,
                            gc_event_fn on_collect,
                            gc_event_fn on_destroy) {
+     return gc_create_slab(nobjects,size,0,on_mark,on_collect,on_destroy);
+}
+
+GarbageCollector gc_create_slab(size_t nobjects,
+                                size_t size,
+                                size_t slab_size,
+                                gc_event_fn on_mark,
+                                gc_event_fn on_collect,
+                                gc_event_fn on_destroy) {
      GarbageCollector gc = xmalloc(sizeof *gc);
 
      /* initialise struct */
      gc->on_mark = on_mark;
      gc->on_collect = on_collect;
      gc->on_destroy = on_destroy;
+     gc->mutators = &gc->main;
+     gc->free_handle = NO_HANDLE;
+     gc->free_weak = NO_HANDLE;
+     gc->occupancy = DEFAULT_OCCUPANCY;
+     gc->min_heap = gc->threshold = DEFAULT_MIN_HEAP;
+     gc->max_heap = (size_t)-1;
+     gc->retain = DEFAULT_MIN_HEAP;
+     gc->release_cycles = DEFAULT_RELEASE_CYCLES;
+     gc->node = GC_NODE_LOCAL;
 
      gc->size = size;
-
-     /* create and put objects on free list */
+     gc->classes[FIXED].stride = object_stride(size);
      size_t i;
-     for (i = 0; i < nobjects; i++)
-          gc->free = node(size,gc->free);
+     for (i = 0; i < NSIZES; i++)
+          gc->classes[1 + i].stride = class_size(i);
+
+     /* a slab spans whole pages and must fit into its alignment */
+     if (!slab_size)
+          slab_size = GC_SLAB_SIZE;
+     if (slab_size > GC_SLAB_ALIGN)
+          slab_size = GC_SLAB_ALIGN;
+     gc->slab_size = gc->chosen_slab_size = align_up(slab_size,page_size());
+
+     /* create and put objects on free lists */
+     gc_add(gc,nobjects);
 
      return gc;
 }
 
-static void destroy_nodes(Node head, gc_event_fn on_destroy) {
-     Node cur = NULL;
-     Node next = NULL;
+static void destroy_slabs(Slab head, gc_event_fn on_destroy) {
+     Slab cur = NULL;
+     Slab next = NULL;
+     size_t w;
      for (cur = head; cur ; cur = next) {
           next = cur->next;
-          if (on_destroy)
-               on_destroy(cur+1); /* call handler with address of object, not header */
-          free(cur);
+          if (on_destroy) {
+               uint64_t* allocs = bitmap(cur,ALLOC_BITS);
+               uint64_t* finalized = bitmap(cur,FINALIZED_BITS);
+               for (w = 0; w < cur->nwords; w++) {
+                    uint64_t used;
+                    for (used = allocs[w] & ~finalized[w]; used; used &= used - 1)
+                         on_destroy(slab_object(cur,w * 64 + ctz64(used)));
+               }
+          }
+          if (!cur->chunked) /* chunks are unmapped as a whole */
+               unmap(cur,cur->bytes);
      }
 }
 
-static void destroy_roots(Root head) {
-     Root cur,next;
-     
-     for (cur = head; cur ; cur = next) {
-          next = cur->next;
-          free(cur);
+/* apply the NUMA placement of gc_set_backing to a new mapping, before
+ * its pages are touched; returns zero on success */
+static int bind_slab(GarbageCollector gc, void* mem, size_t bytes) {
+#if defined(__linux__) && defined(SYS_mbind)
+     int policy = gc->node == GC_NODE_INTERLEAVE ? POLICY_INTERLEAVE : POLICY_BIND;
+     return (int)syscall(SYS_mbind,mem,(unsigned long)bytes,policy,gc->nodes,
+                         (unsigned long)MAX_NODES + 1,0u);
+#else
+     (void)gc;
+     (void)mem;
+     (void)bytes;
+     return -1;
+#endif
+}
+
+/* map the memory of a slab with the backing requested by
+ * gc_set_backing, falling back to ordinary pages; sets the backing
+ * obtained. Returns NULL if no memory can be mapped. */
+static void* map_slab(GarbageCollector gc, size_t bytes, int* backing) {
+     void* mem = NULL;
+     *backing = 0;
+#ifdef MAP_HUGETLB
+     if (gc->pages == GC_PAGES_HUGE) {
+          int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+#ifdef MAP_HUGE_2MB
+          flags |= MAP_HUGE_2MB;
+#endif
+          /* fails unless enough huge pages are reserved */
+          mem = mmap(NULL,bytes,PROT_READ | PROT_WRITE,flags,-1,0);
+          if (mem == MAP_FAILED)
+               mem = NULL;
+          else if ((size_t)mem % GC_SLAB_ALIGN) {
+               unmap(mem,bytes);
+               mem = NULL;
+          }
+          else
+               *backing |= BACKED_HUGE;
+     }
+#endif
+     if (!mem) {
+          mem = map_aligned(bytes);
+          if (!mem)
+               return NULL;
+#ifdef MADV_HUGEPAGE
+          if (gc->pages != GC_PAGES_DEFAULT && madvise(mem,bytes,MADV_HUGEPAGE) == 0)
+               *backing |= BACKED_TRANSPARENT;
+#endif
+     }
+     if (gc->node != GC_NODE_LOCAL && bind_slab(gc,mem,bytes) == 0)
+          *backing |= BACKED_BOUND;
+     return mem;
+}
+
+/* whether the system charges writable memory against its commit limit
+ * when it is mapped, ignoring MAP_NORESERVE (vm.overcommit_memory=2) */
+static int strict_overcommit(void) {
+     static int strict = -1;
+     if (strict < 0) {
+          FILE* f = fopen("/proc/sys/vm/overcommit_memory","r");
+          int mode = 0;
+          if (f) {
+               if (fscanf(f,"%d",&mode) != 1)
+                    mode = 0;
+               fclose(f);
+          }
+          strict = mode == 2;
+     }
+     return strict;
+}
+
+/* turn bytes at mem back into reserved address space, dropping their
+ * pages and commit charge; returns zero on success */
+static int reserve_at(void* mem, size_t bytes) {
+     if (mmap(mem,bytes,PROT_NONE,MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED,
+              -1,0) == MAP_FAILED)
+          return -1;
+#ifdef MADV_NOHUGEPAGE
+     /* a transparent huge page would fill the rest of a slot */
+     madvise(mem,bytes,MADV_NOHUGEPAGE);
+#endif
+     return 0;
+}
+
+/* number of slots of the i-th chunk: small at first, so a small heap
+ * reserves little address space */
+static size_t chunk_slots(size_t i) {
+     return i < 5 ? (size_t)1 << i : CHUNK_SLOTS;
+}
+
+/* Slabs of ordinary pages up to GC_SLAB_ALIGN bytes each take a slot
+ * of that size in a chunk, a single reservation of up to CHUNK_SLOTS
+ * slots. A mapping per slab would cost a kernel mapping each, and the
+ * number of those a process may have is limited. A chunk is reserved
+ * inaccessible and a slot made writable as a slab takes it: only the
+ * bytes of the slab where the system commits memory up front, the
+ * whole slot otherwise, so the writable slots of a chunk stay one
+ * mapping. The rest of a slot is never touched. */
+static void* map_slot(GarbageCollector gc, size_t bytes) {
+     if (!gc->nslots) {
+          size_t n = chunk_slots(gc->nchunks), i;
+          char* chunk = map_aligned_as(n * GC_SLAB_ALIGN,PROT_NONE,MAP_NORESERVE);
+          if (!chunk)
+               return NULL;
+#ifdef MADV_NOHUGEPAGE
+          madvise(chunk,n * GC_SLAB_ALIGN,MADV_NOHUGEPAGE);
+#endif
+          if (gc->nchunks == gc->chunks_size) {
+               size_t size = gc->chunks_size ? 2 * gc->chunks_size : 8;
+               gc->chunks = xrealloc(gc->chunks,size * sizeof *gc->chunks);
+               gc->slots = xrealloc(gc->slots,size * CHUNK_SLOTS * sizeof *gc->slots);
+               gc->chunks_size = size;
+          }
+          gc->chunks[gc->nchunks++] = chunk;
+          for (i = n; i > 0; i--) /* lowest address first */
+               gc->slots[gc->nslots++] = chunk + (i - 1) * GC_SLAB_ALIGN;
+     }
+     void* slot = gc->slots[gc->nslots - 1];
+     if (mprotect(slot,strict_overcommit() ? bytes : GC_SLAB_ALIGN,PROT_READ | PROT_WRITE) != 0)
+          return NULL;
+     gc->nslots--;
+     return slot;
+}
+
+/* map a slab for objects of stride bytes, or return NULL if there is
+ * no memory for it */
+static Slab slab(GarbageCollector gc, size_t bytes, size_t stride) {
+     size_t capacity = slab_capacity(bytes,stride);
+     if (capacity == 0) { /* object larger than a slab: a slab of its own */
+          capacity = 1;
+          bytes = align_up(slab_header(1) + stride,page_size());
+          if (gc->pages != GC_PAGES_DEFAULT) /* whole huge pages only */
+               bytes = align_up(bytes,GC_SLAB_ALIGN);
+     }
+
+     /* mapping is zero-filled, no need to clear it */
+     int backing = 0;
+     int chunked = bytes <= GC_SLAB_ALIGN && gc->pages == GC_PAGES_DEFAULT
+          && gc->node == GC_NODE_LOCAL;
+     Slab s = chunked ? map_slot(gc,bytes) : map_slab(gc,bytes,&backing);
+     if (!s)
+          return NULL;
+     s->backing = backing;
+     s->chunked = chunked;
+     s->gc = gc;
+     s->stride = stride;
+     s->bytes = bytes;
+     s->capacity = capacity;
+     s->nwords = (capacity + 63) / 64;
+     s->bits = (uint64_t*)(s + 1);
+     s->objects = (char*)s + slab_header(capacity);
+
+     return s;
+}
+
+/* carve n objects from the end of a slab, making them available to gc_alloc */
+static void carve(Slab s, size_t n) {
+     s->nobjects += n;
+     s->nfree += n;
+}
+
+/* index of the size class a slab belongs to */
+static size_t slab_class(Slab s) {
+     if (s->fixed)
+          return FIXED;
+     if (s->stride > MAX_CLASS_SIZE)
+          return LARGE;
+     return 1 + size_class(s->stride);
+}
+
+/* append a slab to the heap and its size class */
+static void link_slab(GarbageCollector gc, SizeClass c, Slab s) {
+     if (gc->last)
+          gc->last->next = s;
+     else
+          gc->slabs = s;
+     gc->last = s;
+
+     if (c->last)
+          c->last->sibling = s;
+     else
+          c->first = s;
+     c->last = s;
+     s->fixed = c == &gc->classes[FIXED];
+     if (!c->current) /* every other slab is handed out */
+          c->current = s;
+
+     /* sorted by sort_ranges once the addresses are needed */
+     if (gc->nranges == gc->ranges_size) {
+          size_t size = gc->ranges_size ? 2 * gc->ranges_size : 64;
+          gc->ranges = xrealloc(gc->ranges,size * sizeof *gc->ranges);
+          gc->ranges_size = size;
+     }
+     gc->ranges[gc->nranges++] = s;
+     if ((char*)s + s->bytes > gc->heap_end)
+          gc->heap_end = (char*)s + s->bytes;
+
+     __atomic_add_fetch(&gc->mapped,s->bytes,__ATOMIC_RELAXED);
+     if (s->backing & BACKED_HUGE)
+          gc->stats.huge_bytes += s->bytes;
+     if (s->backing & BACKED_TRANSPARENT)
+          gc->stats.transparent_bytes += s->bytes;
+     if (s->backing & BACKED_BOUND)
+          gc->stats.bound_bytes += s->bytes;
+}
+
+/* give the memory of a slab no longer in the heap back to the system */
+static void unmap_slab(GarbageCollector gc, Slab s) {
+     __atomic_sub_fetch(&gc->mapped,s->bytes,__ATOMIC_RELAXED);
+     gc->marked_objects -= s->marked;
+     gc->marked_bytes -= s->marked * s->stride;
+     if (s->released) {
+          __atomic_sub_fetch(&gc->stats.released_bytes,s->released,__ATOMIC_RELAXED);
+          __atomic_sub_fetch(&gc->idle,s->bytes,__ATOMIC_RELAXED);
+     }
+     if (s->backing & BACKED_HUGE)
+          gc->stats.huge_bytes -= s->bytes;
+     if (s->backing & BACKED_TRANSPARENT)
+          gc->stats.transparent_bytes -= s->bytes;
+     if (s->backing & BACKED_BOUND)
+          gc->stats.bound_bytes -= s->bytes;
+     if (!s->chunked)
+          unmap(s,s->bytes);
+     else if (reserve_at(s,GC_SLAB_ALIGN) == 0) /* zero-filled when reused */
+          gc->slots[gc->nslots++] = s;
+     else /* give up the slot rather than reuse its old contents */
+          unmap(s,GC_SLAB_ALIGN);
+}
+
+static int by_slab(const void* a, const void* b) {
+     uintptr_t x = (uintptr_t)*(const Slab*)a, y = (uintptr_t)*(const Slab*)b;
+     return (x > y) - (x < y);
+}
+
+/* sort the slabs added since the last call into gc->ranges. mmap
+ * usually hands out descending addresses, so inserting each slab in
+ * place would take quadratic time. */
+static void sort_ranges(GarbageCollector gc) {
+     if (gc->nsorted == gc->nranges)
+          return;
+     qsort(gc->ranges,gc->nranges,sizeof *gc->ranges,by_slab);
+     gc->nsorted = gc->nranges;
+}
+
+/* map a new slab and append it to the heap and its size class */
+static Slab add_slab(GarbageCollector gc, SizeClass c, size_t bytes, size_t stride) {
+     Slab s = slab(gc,bytes,stride);
+     if (!s) {
+          fputs("gc: out of memory.\n",stderr);
+          abort();
      }
+     link_slab(gc,c,s);
+     return s;
 }
 
 void  gc_add(GarbageCollector gc, size_t nobjects) {
      assert(gc);
 
-     /* create objects and put them on the free list */
-     size_t i;
-     for (i = 0; i < nobjects; i++)
-          gc->free = node(gc->size,gc->free);
+     SizeClass c = &gc->classes[FIXED];
+     lock(gc);
+     while (nobjects > 0) {
+          if (!c->last || c->last->nobjects == c->last->capacity)
+               add_slab(gc,c,gc->slab_size,c->stride);
+
+          Slab s = c->last;
+          size_t n = s->capacity - s->nobjects;
+          if (n > nobjects)
+               n = nobjects;
+          carve(s,n);
+          nobjects -= n;
+     }
+     unlock(gc);
 }
 
-void  gc_root(GarbageCollector gc , void* object) {
+/* The root set is kept in a dense array, so marking scans it
+ * linearly. A handle indexes a second array holding the position of its
+ * object in the dense one, which lets a root be removed in constant time
+ * by moving the last object into its place. Unused handles are chained
+ * through that same array. */
+size_t gc_root(GarbageCollector gc , void* object) {
      assert(gc);
-     Root r = NULL;
-     if (gc->free_roots) { /* reuse already allocated root node */
-          r = gc->free_roots;
-          r->next = gc->used_roots;
-          gc->free_roots = gc->free_roots->next;
+     size_t h;
+
+     lock(gc);
+     if (gc->nroots == gc->roots_size) {
+          size_t size = gc->roots_size ? 2 * gc->roots_size : 64;
+          gc->roots = xrealloc(gc->roots,size * sizeof *gc->roots);
+          gc->root_handles = xrealloc(gc->root_handles,size * sizeof *gc->root_handles);
+          gc->roots_size = size;
+     }
+
+     if (gc->free_handle != NO_HANDLE) { /* reuse an unused handle */
+          h = gc->free_handle;
+          gc->free_handle = gc->handles[h];
+     }
+     else { /* create a new one */
+          if (gc->nhandles == gc->handles_size) {
+               size_t size = gc->handles_size ? 2 * gc->handles_size : 64;
+               gc->handles = xrealloc(gc->handles,size * sizeof *gc->handles);
+               gc->handles_size = size;
+          }
+          h = gc->nhandles++;
      }
-     else /* create a new one */
-          r = root(gc->used_roots,object);
 
-     gc->used_roots = r;
+     gc->handles[h] = gc->nroots;
+     gc->roots[gc->nroots] = object;
+     gc->root_handles[gc->nroots] = h;
+     gc->nroots++;
+     unlock(gc);
+
+     return h;
+}
+
+/* remove the root at index i of the dense array */
+static void drop_root(GarbageCollector gc, size_t i) {
+     size_t h = gc->root_handles[i];
+
+     /* fill the hole with the last root */
+     gc->nroots--;
+     gc->roots[i] = gc->roots[gc->nroots];
+     gc->root_handles[i] = gc->root_handles[gc->nroots];
+     gc->handles[gc->root_handles[i]] = i;
+
+     gc->handles[h] = gc->free_handle;
+     gc->free_handle = h;
 }
+
 void  gc_unroot(GarbageCollector gc , void* object) {
      assert(gc);
+     size_t i;
 
-     Root cur,prev;
-     /* find object in root list */
-     for (cur = gc->used_roots, prev = NULL;
-          cur; cur = cur->next) {
-          if (cur->data == object) {
-               if (prev)
-                    prev->next = cur->next;
-               else
-                    gc->used_roots = cur->next;
+     lock(gc);
+     for (i = gc->nroots; i-- > 0; )
+          if (gc->roots[i] == object)
+               drop_root(gc,i);
+     unlock(gc);
+}
 
-               /* put it on free root list */
-               cur->data = NULL;
-               cur->next = gc->free_roots;
-               gc->free_roots = cur;
-          }
+void  gc_unroot_handle(GarbageCollector gc, size_t handle) {
+     assert(gc);
 
-          prev = cur;
-     }
-               
+     lock(gc);
+     assert(handle < gc->nhandles);
+     drop_root(gc,gc->handles[handle]);
+     unlock(gc);
 }
+
+/* discard all samples and sites; called with the profile lock held */
+static void clear_profile(GarbageCollector gc) {
+     size_t i;
+     for (i = 0; i < gc->nsites; i++)
+          free(gc->sites[i].frames);
+     free(gc->sites);
+     free(gc->site_table);
+     free(gc->samples);
+     gc->sites = NULL;
+     gc->site_table = NULL;
+     gc->samples = NULL;
+     gc->nsites = gc->sites_size = gc->site_table_size = 0;
+     gc->nsamples = gc->samples_size = 0;
+}
+
 void  gc_free(GarbageCollector* gc) {
      if (!gc)
           return;
      if (!*gc)
           return;
 
-     destroy_nodes((*gc)->free,(*gc)->on_destroy);
-     destroy_nodes((*gc)->active,(*gc)->on_destroy);
-     destroy_roots((*gc)->used_roots);
-     destroy_roots((*gc)->free_roots);
-     destroy_roots((*gc)->used_protected);
-     destroy_roots((*gc)->free_protected);
+     gc_set_background_sweep(*gc,0);
+     destroy_slabs((*gc)->slabs,(*gc)->on_destroy);
+     size_t i;
+     for (i = 0; i < (*gc)->nchunks; i++)
+          unmap((*gc)->chunks[i],chunk_slots(i) * GC_SLAB_ALIGN);
+     free((*gc)->chunks);
+     free((*gc)->slots);
+     free((*gc)->roots);
+     free((*gc)->root_handles);
+     free((*gc)->handles);
+     free((*gc)->weak);
+     while ((*gc)->mutators) {
+          Mutator m = (*gc)->mutators;
+          (*gc)->mutators = m->next;
+          free(m->frames);
+          if (m != &(*gc)->main)
+               free(m);
+     }
+     gc_set_markers(*gc,0);
+     if ((*gc)->mark_cycle) {
+          pthread_mutex_destroy(&(*gc)->mark_lock);
+          pthread_cond_destroy(&(*gc)->mark_start);
+          pthread_cond_destroy(&(*gc)->mark_done);
+          pthread_cond_destroy(&(*gc)->mark_work);
+     }
+     free((*gc)->stack);
+     free((*gc)->pool);
+     free((*gc)->remembered);
+     free((*gc)->slot_refs);
+     free((*gc)->layout);
+     free((*gc)->ranges);
+     free((*gc)->finalize);
+     if ((*gc)->finalizers)
+          pthread_mutex_destroy(&(*gc)->finalize_lock);
+     clear_profile(*gc);
+     if ((*gc)->profiled)
+          pthread_mutex_destroy(&(*gc)->profile_lock);
+     if ((*gc)->threaded) {
+          pthread_key_delete((*gc)->self);
+          pthread_mutex_destroy(&(*gc)->lock);
+          pthread_cond_destroy(&(*gc)->parked);
+          pthread_cond_destroy(&(*gc)->resumed);
+     }
 
      free(*gc);
      
      *gc = NULL;
 }
-void  gc_protect(GarbageCollector gc , void** object) {
+void  gc_protect_frame(GarbageCollector gc, void** slots, size_t n) {
      assert(gc);
-     Root r = NULL;
-     if (gc->free_protected) { /* reuse existing node */
-          r = gc->free_protected;
-          r->next = gc->used_protected;
-          gc->free_protected = gc->free_protected->next;
+     Mutator m = self(gc);
+     assert(m);
+
+     if (m->nframes == m->frames_size) {
+          size_t size = m->frames_size ? 2 * m->frames_size : 64;
+          m->frames = xrealloc(m->frames,size * sizeof *m->frames);
+          m->frames_size = size;
      }
-     else /* create a new one */
-          r = root(gc->used_protected,(void*)object);
+     m->frames[m->nframes].slots = slots;
+     m->frames[m->nframes].n = n;
+     m->nframes++;
+}
 
-     gc->used_protected = r;
+void  gc_protect(GarbageCollector gc , void** object) {
+     gc_protect_frame(gc,object,1);
 }
 
 void  gc_expose(GarbageCollector gc , size_t n) {
      assert(gc);
+     Mutator m = self(gc);
+     assert(m);
 
-     while (n-->0 && gc->used_protected) {
-          /* move nodes from used_protected list to free_protected list */
-          Root r = gc->used_protected;
-          gc->used_protected = r->next;
-          r->next = gc->free_protected;
-          gc->free_protected = r;
-     }
+     m->nframes = n < m->nframes ? m->nframes - n : 0;
 }
 
 static inline int is_marked(void* object) {
-     Node n = (Node)(((char*)object) - sizeof(*n));
-     return n->mark;
+     Slab s = object_slab(object);
+     size_t i = object_index(s,object);
+     return test_bit(s,MARK_BITS,i);
 }
 
 static inline void set_mark(void* object) {
-     Node n = (Node)(((char*)object) - sizeof(*n));
-     n->mark = 1;
+     Slab s = object_slab(object);
+     size_t i = object_index(s,object);
+     set_bit(s,MARK_BITS,i);
 }
-static inline void unset_mark(void* object) {
-     Node n = (Node)(((char*)object) - sizeof(*n));
-     n->mark = 0;
+
+/* marker of the calling thread while it takes part in parallel
+ * marking. Marking code of the collector is handed the marker; only
+ * gc_mark and gc_mark_slot, called back from on_mark, look it up. */
+static __thread Marker self_marker;
+
+/* append n entries to a mark stack */
+static void push_grays(struct gray** stack, size_t* nstack, size_t* size,
+                       const struct gray* items, size_t n) {
+     if (!n)
+          return;
+     if (*nstack + n > *size) {
+          size_t grown = *size ? 2 * *size : 256;
+          while (grown < *nstack + n)
+               grown *= 2;
+          *stack = xrealloc(*stack,grown * sizeof **stack);
+          *size = grown;
+     }
+     memcpy(*stack + *nstack,items,n * sizeof *items);
+     *nstack += n;
 }
 
-void  gc_mark(gc_event_fn cont, void* object) {
-     if (!object || is_marked(object))
+static void push(GarbageCollector gc, Marker m, void* object, gc_event_fn cont) {
+     if (m) {
+          if (m->nstack == m->stack_size) {
+               m->stack_size = m->stack_size ? 2 * m->stack_size : 256;
+               m->stack = xrealloc(m->stack,m->stack_size * sizeof *m->stack);
+          }
+          m->stack[m->nstack].object = object;
+          m->stack[m->nstack].cont = cont;
+          m->nstack++;
           return;
+     }
 
-     set_mark(object);
-     if (cont)
-          cont(object);
+     if (gc->nstack == gc->stack_size) {
+          size_t size = gc->stack_size ? 2 * gc->stack_size : 256;
+          gc->stack = xrealloc(gc->stack,size * sizeof *gc->stack);
+          gc->stack_size = size;
+     }
+
+     gc->stack[gc->nstack].object = object;
+     gc->stack[gc->nstack].cont = cont;
+     gc->nstack++;
 }
 
-/* collect a single object */
-static inline void collect(GarbageCollector gc, Node n, Node prev) {
-     assert(gc);
-     assert(n);
-     
-     if (gc->on_collect) /* call handler if necessary */
-          gc->on_collect(n+1); /* with address of object, not header */
-     if (prev)
-          prev->next = n->next;
-     else /* update list head if no predecessor given */
-          gc->active = n->next;
-     n->next = gc->free;
-     gc->free = n;
+static inline void mark(Slab s, Marker m, gc_event_fn cont, void* object) {
+     size_t i = object_index(s,object);
+     uint64_t* word = bitmap(s,MARK_BITS) + i / 64;
+     uint64_t bit = (uint64_t)1 << (i % 64);
+
+     if (s->gc->parallel) { /* only the thread setting the bit traces it */
+          if (__atomic_fetch_or(word,bit,__ATOMIC_RELAXED) & bit)
+               return;
+     }
+     else {
+          if (*word & bit)
+               return;
+          *word |= bit;
+     }
+
+     /* trace its references later instead of recursing; objects with
+        a layout are pushed without a callback */
+     if (s->fixed && s->gc->by_layout) {
+          if (s->gc->nlayout)
+               push(s->gc,m,object,NULL);
+     }
+     else if (cont)
+          push(s->gc,m,object,cont);
 }
 
-void gc_collect(GarbageCollector gc) {
-     assert(gc);
+void  gc_mark(gc_event_fn cont, void* object) {
+     if (!object)
+          return;
 
-     Root cur;
-     /* mark roots */
-     for (cur = gc->used_roots; cur ; cur = cur->next)
-          gc_mark(gc->on_mark,cur->data);
+     Slab s = object_slab(object);
+     if (s->gc->compacting) /* the reference cannot be updated: keep it in place */
+          set_bit(s,HELD_BITS,object_index(s,object));
+     mark(s,self_marker,cont,object);
+}
 
-     /* mark protected objects */
-     for (cur = gc->used_protected; cur; cur = cur->next)
-          gc_mark(gc->on_mark,*(void**)cur->data);
-     
-     Node n,next,prev;
-     prev = NULL;
+static inline void mark_slot(Marker m, gc_event_fn cont, void** slot) {
+     void* object = *slot;
+     if (!object)
+          return;
 
-     /* sweep */
-     for (n = gc->active; n ; n = next){
-          next = n->next;
-          if (n->mark) {
-               n->mark = 0;
-               prev = n;
+     Slab s = object_slab(object);
+     GarbageCollector gc = s->gc;
+     if (gc->compacting) {
+          if (gc->nslot_refs == gc->slot_refs_size) {
+               size_t size = gc->slot_refs_size ? 2 * gc->slot_refs_size : 256;
+               gc->slot_refs = xrealloc(gc->slot_refs,size * sizeof *gc->slot_refs);
+               gc->slot_refs_size = size;
           }
-          else
-               collect(gc,n,prev);
+          gc->slot_refs[gc->nslot_refs].object = gc->tracing;
+          gc->slot_refs[gc->nslot_refs].slot = slot;
+          gc->nslot_refs++;
+     }
+     mark(s,m,cont,object);
+}
+
+void  gc_mark_slot(gc_event_fn cont, void** slot) {
+     mark_slot(self_marker,cont,slot);
+}
+
+/* trace the references of an object taken from the mark stack, by its
+ * callback or, for objects of gc_alloc, by the layout; m is the marker
+ * of the calling thread during parallel marking, NULL otherwise */
+static inline void trace(GarbageCollector gc, Marker m, struct gray* g) {
+     size_t i;
+     if (g->cont) {
+          g->cont(g->object);
+          return;
+     }
+     for (i = 0; i < gc->nlayout; i++)
+          mark_slot(m,gc->on_mark,(void**)((char*)g->object + gc->layout[i]));
+}
+
+void  gc_pin(void* object) {
+     assert(object);
+     Slab s = object_slab(object);
+     size_t i = object_index(s,object);
+     __atomic_fetch_or(bitmap(s,PINNED_BITS) + i / 64,(uint64_t)1 << (i % 64),__ATOMIC_RELAXED);
+}
+
+void  gc_unpin(void* object) {
+     assert(object);
+     Slab s = object_slab(object);
+     size_t i = object_index(s,object);
+     __atomic_fetch_and(bitmap(s,PINNED_BITS) + i / 64,~((uint64_t)1 << (i % 64)),__ATOMIC_RELAXED);
+}
 
+/* add an old object to the remembered set, once */
+static void remember(GarbageCollector gc, void* object) {
+     Slab s = object_slab(object);
+     size_t i = object_index(s,object);
+     if (test_bit(s,REMEMBERED_BITS,i))
+          return;
+     set_bit(s,REMEMBERED_BITS,i);
+
+     if (gc->nremembered == gc->remembered_size) {
+          size_t size = gc->remembered_size ? 2 * gc->remembered_size : 256;
+          gc->remembered = xrealloc(gc->remembered,size * sizeof *gc->remembered);
+          gc->remembered_size = size;
      }
+     gc->remembered[gc->nremembered++] = object;
 }
 
-void* gc_alloc(GarbageCollector gc) {
+/* empty the remembered set */
+static void forget(GarbageCollector gc) {
+     size_t i;
+     for (i = 0; i < gc->nremembered; i++) {
+          Slab s = object_slab(gc->remembered[i]);
+          clear_bit(s,REMEMBERED_BITS,object_index(s,gc->remembered[i]));
+     }
+     gc->nremembered = 0;
+}
+
+void  gc_write_barrier(void* object, void* value) {
+     if (!value)
+          return;
+
+     GarbageCollector gc = object_slab(value)->gc;
+
+     /* keep black objects from pointing to white ones by shading the
+        stored value gray while an incremental mark is in progress */
+     if (gc->marking)
+          gc_mark(gc->on_mark,value);
+
+     /* marks survive collections in generational mode, so a marked
+        object is old and an unmarked one is young */
+     else if (gc->generational && object && is_marked(object) && !is_marked(value)) {
+          lock(gc);
+          remember(gc,object);
+          unlock(gc);
+     }
+}
+
+size_t gc_weak(GarbageCollector gc, void* key, void* value) {
+     assert(gc);
+     assert(key);
+     size_t h;
+
+     lock(gc);
+     if (gc->free_weak != NO_HANDLE) { /* reuse an unused handle */
+          h = gc->free_weak;
+          gc->free_weak = gc->weak[h].next;
+     }
+     else {
+          if (gc->nweak == gc->weak_size) {
+               size_t size = gc->weak_size ? 2 * gc->weak_size : 64;
+               gc->weak = xrealloc(gc->weak,size * sizeof *gc->weak);
+               gc->weak_size = size;
+          }
+          h = gc->nweak++;
+     }
+     gc->weak[h].key = key;
+     gc->weak[h].value = value;
+     unlock(gc);
+
+     return h;
+}
+
+/* read one side of a weak reference; during an incremental mark the
+ * object is shaded, as the program may store it anywhere */
+static void* weak_get(GarbageCollector gc, size_t handle, int value) {
+     lock(gc);
+     assert(handle < gc->nweak);
+     void* object = value ? gc->weak[handle].value : gc->weak[handle].key;
+     if (gc->marking)
+          gc_mark(gc->on_mark,object);
+     unlock(gc);
+
+     return object;
+}
+
+void* gc_weak_key(GarbageCollector gc, size_t handle) {
+     assert(gc);
+
+     return weak_get(gc,handle,0);
+}
+
+void* gc_weak_value(GarbageCollector gc, size_t handle) {
+     assert(gc);
+
+     return weak_get(gc,handle,1);
+}
+
+void  gc_weak_free(GarbageCollector gc, size_t handle) {
      assert(gc);
 
-     if (!gc->free) gc_collect(gc); /* try to reclaim unused objects */
-     if (!gc->free) return NULL; /* no objects available */
+     lock(gc);
+     assert(handle < gc->nweak);
+     gc->weak[handle].key = gc->weak[handle].value = NULL;
+     gc->weak[handle].next = gc->free_weak;
+     gc->free_weak = handle;
+     unlock(gc);
+}
+
+/* take work from the pool, waiting for it while other marking threads
+ * are busy; returns zero once marking is complete. Only busy threads
+ * create work, so once all are idle and the pool is empty, everything
+ * reachable is marked. */
+static int wait_for_work(GarbageCollector gc, Marker self) {
+     int found = 0;
 
-     /* pop object from free list */
-     Node n = gc->free;
-     gc->free = gc->free->next;
+     pthread_mutex_lock(&gc->mark_lock);
+     gc->nidle++;
+     for (;;) {
+          if (gc->npool > 0) { /* take half of it, the oldest entries */
+               size_t n = (gc->npool + 1) / 2;
+               push_grays(&self->stack,&self->nstack,&self->stack_size,gc->pool,n);
+               memmove(gc->pool,gc->pool + n,(gc->npool - n) * sizeof *gc->pool);
+               __atomic_store_n(&gc->npool,gc->npool - n,__ATOMIC_RELAXED);
+               gc->nidle--;
+               found = 1;
+               break;
+          }
+          if (gc->nidle == gc->nmarkers) {
+               pthread_cond_broadcast(&gc->mark_work);
+               break;
+          }
+          __atomic_add_fetch(&gc->nwaiting,1,__ATOMIC_RELAXED);
+          pthread_cond_wait(&gc->mark_work,&gc->mark_lock);
+          __atomic_sub_fetch(&gc->nwaiting,1,__ATOMIC_RELAXED);
+     }
+     pthread_mutex_unlock(&gc->mark_lock);
 
-     /* push object to active list */
-     n->next = gc->active;
-     gc->active = n;
+     return found;
+}
 
-     n->mark = 0;
+/* move the older half of a mark stack to the pool for waiting marking
+ * threads. The oldest entries are closest to the roots, so they tend
+ * to lead to the most work. */
+static void share_work(GarbageCollector gc, Marker self) {
+     size_t n = self->nstack / 2, npool;
+     pthread_mutex_lock(&gc->mark_lock);
+     npool = gc->npool;
+     push_grays(&gc->pool,&npool,&gc->pool_size,self->stack,n);
+     __atomic_store_n(&gc->npool,npool,__ATOMIC_RELAXED);
+     pthread_cond_broadcast(&gc->mark_work);
+     pthread_mutex_unlock(&gc->mark_lock);
+     memmove(self->stack,self->stack + n,(self->nstack - n) * sizeof *self->stack);
+     self->nstack -= n;
+}
+
+/* trace objects from the own stack until every marking thread is out
+ * of work. Pushing and popping take no locks; the stack is only
+ * shared, in halves, while another thread waits for work. */
+static void mark_loop(GarbageCollector gc, Marker self) {
+     self_marker = self;
+     do {
+          while (self->nstack > 0) {
+               struct gray g = self->stack[--self->nstack];
+#ifdef __GNUC__
+               if (self->nstack > 0) /* fetch the next object while tracing this one */
+                    __builtin_prefetch(self->stack[self->nstack - 1].object);
+#endif
+               trace(gc,self,&g);
+               /* a waiting thread missed here is seen on a later round */
+               if (self->nstack > 1 && __atomic_load_n(&gc->nwaiting,__ATOMIC_RELAXED) > 0
+                   && __atomic_load_n(&gc->npool,__ATOMIC_RELAXED) == 0)
+                    share_work(gc,self);
+          }
+     } while (wait_for_work(gc,self));
+     self_marker = NULL;
+}
+
+static void* marker_main(void* arg) {
+     Marker m = arg;
+     GarbageCollector gc = m->gc;
+
+     pthread_mutex_lock(&gc->mark_lock);
+     for (;;) {
+          while (!gc->quit && gc->mark_cycle == m->cycle)
+               pthread_cond_wait(&gc->mark_start,&gc->mark_lock);
+          if (gc->quit)
+               break;
+          m->cycle = gc->mark_cycle;
+          pthread_mutex_unlock(&gc->mark_lock);
+
+          mark_loop(gc,m);
+
+          pthread_mutex_lock(&gc->mark_lock);
+          gc->nfinished++;
+          pthread_cond_signal(&gc->mark_done);
+     }
+     pthread_mutex_unlock(&gc->mark_lock);
+
+     return NULL;
+}
+
+/* stop and release all helper threads */
+static void stop_markers(GarbageCollector gc) {
+     size_t i;
+
+     if (!gc->markers)
+          return;
+
+     pthread_mutex_lock(&gc->mark_lock);
+     gc->quit = 1;
+     pthread_cond_broadcast(&gc->mark_start);
+     pthread_mutex_unlock(&gc->mark_lock);
+
+     for (i = 0; i < gc->nmarkers; i++) {
+          if (i > 0)
+               pthread_join(gc->markers[i].thread,NULL);
+          free(gc->markers[i].stack);
+     }
+     free(gc->markers);
+     gc->markers = NULL;
+     gc->nmarkers = 0;
+     gc->quit = 0;
+}
+
+void  gc_set_markers(GarbageCollector gc, size_t n) {
+     assert(gc);
+     size_t i;
+
+     stop_markers(gc);
+     if (n < 2)
+          return;
+
+     if (!gc->mark_cycle) { /* first use */
+          pthread_mutex_init(&gc->mark_lock,NULL);
+          pthread_cond_init(&gc->mark_start,NULL);
+          pthread_cond_init(&gc->mark_done,NULL);
+          pthread_cond_init(&gc->mark_work,NULL);
+          gc->mark_cycle = 1;
+     }
+
+     gc->markers = xmalloc(n * sizeof *gc->markers);
+     gc->nmarkers = n;
+     for (i = 0; i < n; i++) {
+          Marker m = &gc->markers[i];
+          m->gc = gc;
+          m->stack = NULL;
+          m->nstack = m->stack_size = 0;
+          m->cycle = gc->mark_cycle;
+          if (i > 0 && pthread_create(&m->thread,NULL,marker_main,m) != 0) {
+               fputs("gc: cannot create marking thread.\n",stderr);
+               abort();
+          }
+     }
+}
+
+/* trace at most work objects from the mark stack; returns the number
+ * of objects traced */
+static size_t drain(GarbageCollector gc, size_t work) {
+     size_t done = 0;
+     while (gc->nstack > 0 && done < work) {
+          struct gray g = gc->stack[--gc->nstack];
+#ifdef __GNUC__
+          if (gc->nstack > 0) /* fetch the next object while tracing this one */
+               __builtin_prefetch(gc->stack[gc->nstack - 1].object);
+#endif
+          gc->tracing = g.object;
+          trace(gc,NULL,&g);
+          done++;
+     }
+     return done;
+}
+
+/* trace everything reachable from the mark stack, in parallel if
+ * several marking threads are configured */
+static void drain_all(GarbageCollector gc) {
+     if (gc->nmarkers < 2) {
+          drain(gc,(size_t)-1);
+          return;
+     }
+
+     /* hand the mark stack to the first marker, which shares it with
+        the others as they wait for work */
+     Marker first = &gc->markers[0];
+     push_grays(&first->stack,&first->nstack,&first->stack_size,gc->stack,gc->nstack);
+     gc->nstack = 0;
+
+     gc->nidle = 0;
+     gc->parallel = 1;
+
+     pthread_mutex_lock(&gc->mark_lock);
+     gc->nfinished = 0;
+     gc->mark_cycle++;
+     pthread_cond_broadcast(&gc->mark_start);
+     pthread_mutex_unlock(&gc->mark_lock);
+
+     mark_loop(gc,first);
+
+     pthread_mutex_lock(&gc->mark_lock);
+     while (gc->nfinished < gc->nmarkers - 1)
+          pthread_cond_wait(&gc->mark_done,&gc->mark_lock);
+     pthread_mutex_unlock(&gc->mark_lock);
+
+     gc->parallel = 0;
+}
+
+/* bytes of the heap that are not given back to the system */
+static size_t resident(GarbageCollector gc) {
+     return __atomic_load_n(&gc->mapped,__ATOMIC_RELAXED)
+          - __atomic_load_n(&gc->stats.released_bytes,__ATOMIC_RELAXED);
+}
+
+/* give the object pages of a slab without objects back to the system
+ * once it has been found empty by release_cycles sweeps in a row, as
+ * long as at least retain bytes of the heap stay in memory. The slab
+ * stays in the heap and gets its pages back, zero-filled, on first
+ * use. */
+static void release(GarbageCollector gc, Slab s) {
+     if (!gc->release_cycles || s->released || s->owner)
+          return;
+     if (s->backing & BACKED_HUGE) /* only whole huge pages can go back */
+          return;
+     if (++s->empty < gc->release_cycles)
+          return;
+
+     char* start = (char*)align_up((size_t)s->objects,page_size());
+     char* end = (char*)s + s->bytes;
+     if (start >= end) /* objects share the header page */
+          return;
+
+     size_t bytes = (size_t)(end - start);
+     if (resident(gc) < gc->retain + bytes)
+          return;
+
+     if (madvise(start,bytes,MADV_DONTNEED) == 0) {
+          s->released = bytes;
+          __atomic_add_fetch(&gc->stats.released_bytes,bytes,__ATOMIC_RELAXED);
+          __atomic_add_fetch(&gc->idle,s->bytes,__ATOMIC_RELAXED);
+     }
+}
+
+/* account for a slab taken into use again */
+static void reuse(GarbageCollector gc, Slab s) {
+     s->empty = 0;
+     if (s->released) {
+          __atomic_sub_fetch(&gc->stats.released_bytes,s->released,__ATOMIC_RELAXED);
+          __atomic_sub_fetch(&gc->idle,s->bytes,__ATOMIC_RELAXED);
+          s->released = 0;
+     }
+}
+
+/* queue the dead objects of a slab for gc_run_finalizers. They stay
+ * allocated until a sweep finds them finalized. */
+static void defer(GarbageCollector gc, Slab s) {
+     uint64_t* marks = bitmap(s,MARK_BITS);
+     uint64_t* allocs = bitmap(s,ALLOC_BITS);
+     uint64_t* queued = bitmap(s,QUEUED_BITS);
+     size_t w;
+
+     pthread_mutex_lock(&gc->finalize_lock);
+     for (w = 0; w < s->nwords; w++) {
+          uint64_t dead = allocs[w] & ~marks[w] & ~queued[w];
+          queued[w] |= dead;
+          for (; dead; dead &= dead - 1) {
+               if (gc->nfinalize == gc->finalize_size) {
+                    size_t size = gc->finalize_size ? 2 * gc->finalize_size : 256;
+                    gc->finalize = xrealloc(gc->finalize,size * sizeof *gc->finalize);
+                    gc->finalize_size = size;
+               }
+               gc->finalize[gc->nfinalize++] = slab_object(s,w * 64 + ctz64(dead));
+          }
+     }
+     pthread_mutex_unlock(&gc->finalize_lock);
+}
+
+/* queued objects of bitmap word w that still wait for finalization;
+ * finalized ones leave the queue and are free from now on */
+static inline uint64_t pending(Slab s, size_t w) {
+     uint64_t* queued = bitmap(s,QUEUED_BITS) + w;
+     uint64_t* finalized = bitmap(s,FINALIZED_BITS) + w;
+     uint64_t done = __atomic_load_n(finalized,__ATOMIC_ACQUIRE) & *queued;
+     if (done) {
+          *queued &= ~done;
+          __atomic_fetch_and(finalized,~done,__ATOMIC_RELAXED);
+     }
+     return *queued;
+}
+
+/* sweep a single slab: every allocated object without a mark is
+ * collected, and the marks are cleared for the next cycle. Both are
+ * done a bitmap word (64 objects) at a time. */
+static void sweep(GarbageCollector gc, Slab s) {
+     uint64_t* marks = bitmap(s,MARK_BITS);
+     uint64_t* allocs = bitmap(s,ALLOC_BITS);
+     uint64_t* pins = bitmap(s,PINNED_BITS);
+     uint64_t* queued = bitmap(s,QUEUED_BITS);
+     size_t w, used = 0, allocated = 0;
+     unsigned long long start = now_ns();
+
+     for (w = 0; w < s->nwords; w++)
+          allocated += popcount64(allocs[w]);
+
+     if (gc->deferred)
+          defer(gc,s);
+     else if (gc->on_collect) { /* call handler for every dead object */
+          for (w = 0; w < s->nwords; w++) {
+               uint64_t dead;
+               for (dead = allocs[w] & ~marks[w] & ~queued[w]; dead; dead &= dead - 1)
+                    gc->on_collect(slab_object(s,w * 64 + ctz64(dead)));
+          }
+     }
+
+     /* only marked objects and those waiting for finalization stay
+        allocated */
+     for (w = 0; w < s->nwords; w++) {
+          uint64_t live = marks[w];
+          if (gc->finalizers)
+               live |= pending(s,w);
+          allocs[w] &= live;
+          /* gc_pin may set bits while the sweeper runs */
+          __atomic_fetch_and(&pins[w],allocs[w],__ATOMIC_RELAXED);
+          used += popcount64(allocs[w]);
+     }
+     if (gc->generational) { /* survivors are old: keep them marked */
+          for (w = 0; w < s->nwords; w++)
+               marks[w] = allocs[w] & ~queued[w];
+     }
+     else
+          memset(marks,0,s->nwords * sizeof *marks);
+
+     s->nfree = s->nobjects - used;
+     s->cursor = 0;
+     s->young = 0;
+     if (used == 0)
+          release(gc,s);
+     else
+          s->empty = 0;
+
+     /* sweeps may run on the sweeping thread */
+     __atomic_add_fetch(&gc->stats.swept,allocated,__ATOMIC_RELAXED);
+     __atomic_add_fetch(&gc->stats.reclaimed,allocated - used,__ATOMIC_RELAXED);
+     __atomic_add_fetch(&gc->stats.last_reclaimed,allocated - used,__ATOMIC_RELAXED);
+     __atomic_add_fetch(&gc->stats.sweep_ns,now_ns() - start,__ATOMIC_RELAXED);
+}
+
+/* sweep a slab left over from a lazy or background collection. If the
+ * sweeping thread is at it already, wait for it instead. */
+static void sweep_pending(GarbageCollector gc, Slab s) {
+     if (!gc->background) {
+          if (s->unswept) {
+               sweep(gc,s);
+               s->unswept = SWEPT;
+          }
+          return;
+     }
+
+     pthread_mutex_lock(&gc->sweep_lock);
+     while (s->unswept == SWEEPING)
+          pthread_cond_wait(&gc->swept,&gc->sweep_lock);
+     int pending = s->unswept == UNSWEPT;
+     if (pending)
+          s->unswept = SWEEPING;
+     pthread_mutex_unlock(&gc->sweep_lock);
+
+     if (pending) {
+          sweep(gc,s);
+          pthread_mutex_lock(&gc->sweep_lock);
+          s->unswept = SWEPT;
+          pthread_cond_broadcast(&gc->swept);
+          pthread_mutex_unlock(&gc->sweep_lock);
+     }
+}
+
+/* sweep all slabs left over from a lazy or background collection */
+static void finish_sweep(GarbageCollector gc) {
+     Slab s;
+     for (s = gc->slabs; s ; s = s->next)
+          sweep_pending(gc,s);
+}
+
+/* sweep the slabs of each collection in heap order, the same order in
+ * which claim hands them out, so gc_alloc rarely has to wait */
+static void* sweeper_main(void* arg) {
+     GarbageCollector gc = arg;
+     unsigned long cycle = 0;
+
+     pthread_mutex_lock(&gc->sweep_lock);
+     for (;;) {
+          while (!gc->sweep_quit && gc->sweep_cycle == cycle)
+               pthread_cond_wait(&gc->sweep_start,&gc->sweep_lock);
+          if (gc->sweep_quit)
+               break;
+          cycle = gc->sweep_cycle;
+
+          /* slabs added after the collection are never unswept, and the
+             next pointer of the last one may be changing */
+          Slab s = gc->slabs, end = gc->sweep_end;
+          while (s) {
+               if (s->unswept == UNSWEPT) {
+                    s->unswept = SWEEPING;
+                    pthread_mutex_unlock(&gc->sweep_lock);
+                    sweep(gc,s);
+                    pthread_mutex_lock(&gc->sweep_lock);
+                    s->unswept = SWEPT;
+                    pthread_cond_broadcast(&gc->swept);
+               }
+               s = s == end ? NULL : s->next;
+          }
+     }
+     pthread_mutex_unlock(&gc->sweep_lock);
+
+     return NULL;
+}
+
+/* take the lowest free object from a slab, or NULL if it is full */
+static inline void* slab_alloc(Slab s) {
+     uint64_t* allocs = bitmap(s,ALLOC_BITS);
+     size_t w;
+
+     for (w = s->cursor; w < s->nwords; w++) {
+          uint64_t avail = ~allocs[w];
+          if (avail) {
+               size_t i = w * 64 + ctz64(avail);
+               if (i >= s->nobjects) /* not carved yet */
+                    break;
+               allocs[w] |= avail & -avail;
+               s->cursor = w;
+               s->nfree--;
+               return slab_object(s,i);
+          }
+     }
+
+     s->cursor = w;
+     return NULL;
+}
+
+/* take up to n free objects from a slab, claiming them a bitmap word
+ * at a time; returns the number of objects taken */
+static size_t slab_alloc_n(Slab s, void** objects, size_t n) {
+     uint64_t* allocs = bitmap(s,ALLOC_BITS);
+     size_t k = 0;
+
+     for (; s->cursor < s->nwords; s->cursor++) {
+          uint64_t avail = ~allocs[s->cursor], taken = 0;
+          for (; avail && k < n; avail &= avail - 1) {
+               size_t i = s->cursor * 64 + ctz64(avail);
+               if (i >= s->nobjects) /* not carved yet */
+                    break;
+               taken |= avail & -avail;
+               objects[k++] = slab_object(s,i);
+          }
+          allocs[s->cursor] |= taken;
+          if (avail || k == n)
+               break;
+     }
+
+     s->nfree -= k;
+     return k;
+}
+
+/* the allocated object an address points into, or NULL */
+static void* find_object(GarbageCollector gc, char* p) {
+     if (!gc->nranges || p < (char*)gc->ranges[0] || p >= gc->heap_end)
+          return NULL;
+
+     size_t lo = 0, hi = gc->nranges; /* find the last slab starting at or below p */
+     while (hi - lo > 1) {
+          size_t mid = lo + (hi - lo) / 2;
+          if ((char*)gc->ranges[mid] <= p)
+               lo = mid;
+          else
+               hi = mid;
+     }
+
+     Slab s = gc->ranges[lo];
+     if (p < s->objects || p >= s->objects + s->nobjects * s->stride)
+          return NULL;
+     size_t i = object_index(s,p);
+     if (!test_bit(s,ALLOC_BITS,i) || test_bit(s,QUEUED_BITS,i))
+          return NULL;
+     return slab_object(s,i);
+}
+
+/* mark every object a word of [start,end) points into */
+NO_SANITIZE_ADDRESS
+static void scan_range(GarbageCollector gc, char* start, char* end) {
+     void** word = (void**)align_up((size_t)start,sizeof(void*));
+     for (; (char*)word + sizeof(void*) <= end; word++) {
+          void* object = find_object(gc,*word);
+          if (object)
+               gc_mark(gc->on_mark,object);
+     }
+}
+
+/* end of the calling thread's stack */
+static char* stack_base(void) {
+#if defined(__GLIBC__)
+     pthread_attr_t attr;
+     void* addr;
+     size_t size;
+     if (pthread_getattr_np(pthread_self(),&attr) == 0) {
+          pthread_attr_getstack(&attr,&addr,&size);
+          pthread_attr_destroy(&attr);
+          return (char*)addr + size;
+     }
+#elif defined(__APPLE__)
+     return pthread_get_stackaddr_np(pthread_self());
+#endif
+     fputs("gc: cannot find the stack of a thread.\n",stderr);
+     abort();
+}
+
+/* lowest address of the current frame holding locals, including regs,
+ * or registers the frame saved on entry */
+#ifdef __GNUC__
+#define FRAME_TOP(regs) ((char*)__builtin_frame_address(0) < (char*)(regs) ? \
+                         (char*)__builtin_frame_address(0) : (char*)(regs))
+#else
+#define FRAME_TOP(regs) ((char*)(regs))
+#endif
+
+/* spill the registers into the current frame, so references only held
+ * in registers are found on the stack */
+#ifdef __GNUC__
+#define SPILL_REGISTERS(regs) (__builtin_unwind_init(),setjmp(regs))
+#else
+#define SPILL_REGISTERS(regs) setjmp(regs)
+#endif
+
+/* scan the stacks of all threads: the own one from here, the others
+ * from where they parked */
+NO_SANITIZE_ADDRESS
+static void scan_stacks(GarbageCollector gc) {
+     jmp_buf regs;
+     Mutator me, m;
+
+     SPILL_REGISTERS(regs);
+     me = self(gc);
+     sort_ranges(gc); /* for find_object */
+     for (m = gc->mutators; m; m = m->next) {
+          if (m == me) {
+               if (!m->stack_base)
+                    m->stack_base = stack_base();
+               scan_range(gc,FRAME_TOP(regs),m->stack_base);
+          }
+          else if (m->stack_top)
+               scan_range(gc,m->stack_top,m->stack_base);
+     }
+}
+
+static void mark_roots(GarbageCollector gc) {
+     Mutator m;
+     size_t i, j;
+     /* mark objects referenced from the stacks */
+     if (gc->conservative)
+          scan_stacks(gc);
+
+     /* mark roots */
+     for (i = 0; i < gc->nroots; i++)
+          gc_mark(gc->on_mark,gc->roots[i]);
+
+     /* mark protected objects of every thread */
+     for (m = gc->mutators; m; m = m->next)
+          for (i = 0; i < m->nframes; i++)
+               for (j = 0; j < m->frames[i].n; j++)
+                    gc_mark_slot(gc->on_mark,m->frames[i].slots + j);
+
+     /* keep the objects of an unfinished gc_alloc_n, without tracing
+        them: they are not initialized yet */
+     for (m = gc->mutators; m; m = m->next)
+          for (i = 0; i < m->nbatch; i++)
+               set_mark(m->batch[i]);
+
+     /* objects waiting for finalization, and everything they reference,
+        stay in place until their finalizer has run */
+     if (gc->finalizers) {
+          pthread_mutex_lock(&gc->finalize_lock);
+          for (i = 0; i < gc->nfinalize; i++)
+               gc_mark(gc->on_mark,gc->finalize[i]);
+          pthread_mutex_unlock(&gc->finalize_lock);
+          for (m = gc->mutators; m; m = m->next)
+               for (i = 0; i < m->nfinalizing; i++)
+                    gc_mark(gc->on_mark,m->finalizing[i]);
+     }
+}
+
+/* clear all marks, making every object young again */
+static void clear_marks(GarbageCollector gc) {
+     Slab s;
+     for (s = gc->slabs; s ; s = s->next)
+          memset(bitmap(s,MARK_BITS),0,s->nwords * sizeof(uint64_t));
+}
+
+/* mark the values of weak references whose keys are marked, and what
+ * they reference, until no further key becomes reachable that way.
+ * While compacting, marking has to stay on this thread. */
+static void mark_weak(GarbageCollector gc, int serial) {
+     int found = 1;
+     size_t i;
+     while (found) {
+          found = 0;
+          for (i = 0; i < gc->nweak; i++) {
+               struct weak* w = &gc->weak[i];
+               if (w->key && w->value && is_marked(w->key) && !is_marked(w->value)) {
+                    gc->tracing = NULL; /* the slot is not inside an object */
+                    gc_mark_slot(gc->on_mark,&w->value);
+                    found = 1;
+               }
+          }
+          if (found && serial)
+               drain(gc,(size_t)-1);
+          else if (found)
+               drain_all(gc);
+     }
+}
+
+/* clear the weak references to objects that were not marked */
+static void clear_weak(GarbageCollector gc) {
+     size_t i;
+     for (i = 0; i < gc->nweak; i++) {
+          struct weak* w = &gc->weak[i];
+          if (w->key && !is_marked(w->key))
+               w->key = w->value = NULL;
+     }
+}
+
+/* draw the number of bytes a thread allocates before its next sample,
+ * uniformly distributed around interval so that allocation patterns
+ * cannot line up with the samples */
+static size_t next_sample(Mutator m, size_t interval) {
+     uint64_t x = m->sample_seed; /* xorshift */
+     x ^= x << 13;
+     x ^= x >> 7;
+     x ^= x << 17;
+     m->sample_seed = x;
+     return 1 + (size_t)(x % (2 * (uint64_t)interval));
+}
+
+static size_t hash_frames(void** frames, size_t n) {
+     size_t h = 14695981039346656037ULL & (size_t)-1, i;
+     for (i = 0; i < n; i++)
+          h = (h ^ (size_t)frames[i]) * (1099511628211ULL & (size_t)-1);
+     return h;
+}
+
+/* index of the site allocating from a stack, added if it is new;
+ * called with the profile lock held */
+static size_t find_site(GarbageCollector gc, void** frames, size_t n) {
+     size_t h = hash_frames(frames,n), i;
+     if (2 * (gc->nsites + 1) > gc->site_table_size) { /* rehash */
+          size_t size = gc->site_table_size ? 2 * gc->site_table_size : 256;
+          free(gc->site_table);
+          gc->site_table = xmalloc(size * sizeof *gc->site_table);
+          gc->site_table_size = size;
+          for (i = 0; i < gc->nsites; i++) {
+               size_t j = gc->sites[i].hash & (size - 1);
+               while (gc->site_table[j])
+                    j = (j + 1) & (size - 1);
+               gc->site_table[j] = i + 1;
+          }
+     }
+
+     /* the table holds site indexes plus one, zero marks a free entry */
+     size_t mask = gc->site_table_size - 1;
+     for (i = h & mask; gc->site_table[i]; i = (i + 1) & mask) {
+          struct site* s = &gc->sites[gc->site_table[i] - 1];
+          if (s->hash == h && s->nframes == n && !memcmp(s->frames,frames,n * sizeof *frames))
+               return gc->site_table[i] - 1;
+     }
+
+     if (gc->nsites == gc->sites_size) {
+          size_t size = gc->sites_size ? 2 * gc->sites_size : 64;
+          gc->sites = xrealloc(gc->sites,size * sizeof *gc->sites);
+          gc->sites_size = size;
+     }
+     struct site* s = &gc->sites[gc->nsites];
+     memset(s,0,sizeof *s);
+     s->hash = h;
+     s->nframes = n;
+     s->frames = xmalloc((n + 1) * sizeof *frames);
+     memcpy(s->frames,frames,n * sizeof *frames);
+     gc->site_table[i] = ++gc->nsites;
+     return gc->nsites - 1;
+}
+
+/* record an allocation picked by the sampling interval, with the stack
+ * from caller, the return address of the public allocation function,
+ * on up */
+static void take_sample(GarbageCollector gc, Mutator m, void* object, size_t size, void* caller) {
+     /* gc_set_profiling may change the interval at any time */
+     pthread_mutex_lock(&gc->profile_lock);
+     size_t interval = gc->sample_bytes;
+     int sampled = interval != 0;
+     if (sampled && !m->sample_seed) { /* first allocation since this thread started profiling */
+          m->sample_seed = ((uint64_t)(uintptr_t)m ^ now_ns()) | 1;
+          m->sample_left = next_sample(m,interval);
+          if (m->sample_left > size) {
+               m->sample_left -= size;
+               sampled = 0;
+          }
+     }
+     if (sampled)
+          m->sample_left = next_sample(m,interval);
+     pthread_mutex_unlock(&gc->profile_lock);
+     if (!sampled)
+          return;
+
+     void* frames[MAX_FRAMES + SKIPPED_FRAMES];
+     size_t n = 0, skip = 0;
+#ifdef HAVE_BACKTRACE
+     n = (size_t)backtrace(frames,MAX_FRAMES + SKIPPED_FRAMES);
+     while (skip < n && skip < SKIPPED_FRAMES && frames[skip] != caller)
+          skip++;
+     if (skip == n || frames[skip] != caller) /* caller not found: keep all frames */
+          skip = 0;
+     if (n - skip > MAX_FRAMES)
+          n = skip + MAX_FRAMES;
+#else
+     (void)caller;
+#endif
+
+     /* an object smaller than the interval stands for all the bytes
+        allocated since the previous sample */
+     size_t bytes = size > interval ? size : interval;
+     pthread_mutex_lock(&gc->profile_lock);
+     if (gc->sample_bytes) { /* not disabled in the meantime */
+          size_t i = find_site(gc,frames + skip,n - skip);
+          gc->sites[i].allocated_bytes += bytes;
+          gc->sites[i].live_bytes += bytes;
+          if (gc->nsamples == gc->samples_size) {
+               size_t size = gc->samples_size ? 2 * gc->samples_size : 256;
+               gc->samples = xrealloc(gc->samples,size * sizeof *gc->samples);
+               gc->samples_size = size;
+          }
+          gc->samples[gc->nsamples].object = object;
+          gc->samples[gc->nsamples].site = i;
+          gc->samples[gc->nsamples].bytes = bytes;
+          gc->nsamples++;
+     }
+     pthread_mutex_unlock(&gc->profile_lock);
+}
+
+/* whether allocations are being sampled */
+static inline int profiling(GarbageCollector gc) {
+     return __atomic_load_n(&gc->sample_bytes,__ATOMIC_RELAXED) != 0;
+}
+
+/* count bytes allocated by the calling thread, sampling object when
+ * the current sampling interval is used up */
+static inline void profile(GarbageCollector gc, void* object, size_t size, void* caller) {
+     Mutator m = self(gc);
+     if (m->sample_left > size)
+          m->sample_left -= size;
+     else
+          take_sample(gc,m,object,size,caller);
+}
+
+/* drop the samples of objects the marking just finished found dead */
+static void forget_samples(GarbageCollector gc) {
+     if (!gc->profiled)
+          return;
+
+     /* gc_set_profiling may clear the samples from any thread */
+     size_t i, n = 0;
+     pthread_mutex_lock(&gc->profile_lock);
+     for (i = 0; i < gc->nsamples; i++) {
+          struct sample* p = &gc->samples[i];
+          if (is_marked(p->object))
+               gc->samples[n++] = *p;
+          else
+               gc->sites[p->site].live_bytes -= p->bytes;
+     }
+     gc->nsamples = n;
+     pthread_mutex_unlock(&gc->profile_lock);
+}
+
+/* whether a slab held a large object that a sweep has freed */
+static int freed_large(Slab s) {
+     return slab_class(s) == LARGE && s->nfree == s->nobjects && s->unswept == SWEPT;
+}
+
+/* unmap the slabs of freed large objects. A slab only fits objects of
+ * its own size, so keeping it would let objects of many different
+ * sizes fill the heap. Called with the world stopped and no sweep in
+ * progress. */
+static void unmap_large(GarbageCollector gc) {
+     SizeClass k = &gc->classes[LARGE];
+     Slab s, prev = NULL, dead = NULL;
+     Slab* link;
+     for (link = &k->first; (s = *link); ) {
+          if (freed_large(s))
+               *link = s->sibling;
+          else {
+               prev = s;
+               link = &s->sibling;
+          }
+     }
+     k->last = prev;
+
+     prev = NULL;
+     for (link = &gc->slabs; (s = *link); ) {
+          if (freed_large(s)) {
+               *link = s->next;
+               s->next = dead;
+               dead = s;
+          }
+          else {
+               prev = s;
+               link = &s->next;
+          }
+     }
+     gc->last = prev;
+     if (!dead)
+          return;
+
+     size_t i, n = 0, sorted = 0;
+     for (i = 0; i < gc->nranges; i++) {
+          if (freed_large(gc->ranges[i]))
+               continue;
+          sorted += i < gc->nsorted;
+          gc->ranges[n++] = gc->ranges[i];
+     }
+     gc->nranges = n;
+     gc->nsorted = sorted;
+
+     for (s = dead; s; s = prev) {
+          prev = s->next;
+          unmap_slab(gc,s);
+     }
+}
+
+/* sweep the whole heap, or only slabs with young objects, eagerly,
+ * lazily or in the background */
+static void sweep_heap(GarbageCollector gc, int minor) {
+     Slab s;
+     __atomic_store_n(&gc->stats.last_reclaimed,0,__ATOMIC_RELAXED);
+     if (gc->background)
+          pthread_mutex_lock(&gc->sweep_lock);
+     for (s = gc->slabs; s ; s = s->next) {
+          if (minor && !s->young)
+               continue;
+          /* leave sweeping to gc_alloc or the sweeper, except for large
+             objects, whose slabs are unmapped right away */
+          if ((gc->lazy || gc->background) && slab_class(s) != LARGE)
+               s->unswept = UNSWEPT;
+          else
+               sweep(gc,s);
+     }
+     unmap_large(gc);
+     if (gc->background) {
+          gc->sweep_end = gc->last;
+          gc->sweep_cycle++;
+          pthread_cond_signal(&gc->sweep_start);
+          pthread_mutex_unlock(&gc->sweep_lock);
+     }
+
+     /* gc_alloc only takes objects from swept slabs; threads keep
+        allocating from the slabs they own */
+     Mutator m;
+     size_t c;
+     for (m = gc->mutators; m; m = m->next)
+          for (c = 0; c < NCLASSES; c++)
+               if (m->current[c])
+                    sweep_pending(gc,m->current[c]);
+     for (c = 0; c < NCLASSES; c++)
+          gc->classes[c].current = gc->classes[c].first;
+}
+
+/* replace the marked count of a slab in the running totals */
+static void recount(GarbageCollector gc, Slab s) {
+     uint64_t* marks = bitmap(s,MARK_BITS);
+     size_t n = 0, w;
+     for (w = 0; w < s->nwords; w++)
+          n += popcount64(marks[w]);
+     gc->marked_objects += n - s->marked;
+     gc->marked_bytes += (n - s->marked) * s->stride;
+     s->marked = n;
+}
+
+/* count the marked objects, i.e. the objects surviving a collection
+ * once marking is done. A minor collection only recounts the slabs it
+ * sweeps: the marks of old slabs have not changed since their last
+ * count, which the running totals still hold. */
+static void count_live(GarbageCollector gc, int minor) {
+     Slab s;
+     for (s = gc->slabs; s ; s = s->next)
+          if (!minor || s->young)
+               recount(gc,s);
+     gc->stats.marked += gc->marked_objects;
+     gc->stats.last_marked = gc->marked_objects;
+     gc->stats.live_bytes = gc->marked_bytes;
+}
+
+/* let the heap grow until the live objects fill the target fraction
+ * of it, so the next collection comes after the program allocated
+ * about as much as the heap can take in addition */
+static void set_threshold(GarbageCollector gc) {
+     double target = (double)gc->stats.live_bytes / gc->occupancy;
+     size_t threshold = target < (double)gc->max_heap ? (size_t)target : gc->max_heap;
+     gc->threshold = threshold < gc->min_heap ? gc->min_heap : threshold;
+     gc->handed = 0;
+}
+
+/* add the time since start to the marking time */
+static void mark_time(GarbageCollector gc, unsigned long long start) {
+     unsigned long long t = now_ns() - start;
+     gc->stats.mark_ns += t;
+     gc->stats.last_mark_ns += t;
+}
+
+static void start_mark(GarbageCollector gc) {
+     /* marks of the previous cycle must be consumed before marking */
+     finish_sweep(gc);
+
+     unsigned long long start = now_ns();
+     gc->stats.last_mark_ns = 0;
+     if (gc->generational) /* a major collection traces old objects too */
+          clear_marks(gc);
+     mark_roots(gc);
+     gc->marking = 1;
+     mark_time(gc,start);
+}
+
+/* finish marking and sweep, eagerly or lazily */
+static void finish_collect(GarbageCollector gc) {
+     unsigned long long start = now_ns();
+     /* roots and protected slots are not covered by the write barrier,
+        so scan them again before declaring everything else dead */
+     mark_roots(gc);
+     drain_all(gc);
+     mark_weak(gc,0);
+     clear_weak(gc);
+     forget_samples(gc);
+     gc->marking = 0;
+     mark_time(gc,start);
+
+     /* all survivors become old, so no old object points to a young one */
+     forget(gc);
+     count_live(gc,0);
+     set_threshold(gc);
+     sweep_heap(gc,0);
+     gc->stats.collections++;
+}
+
+/* count a pause of the program that started at start */
+static void pause_time(GarbageCollector gc, unsigned long long start) {
+     unsigned long long t = now_ns() - start;
+     unsigned long long us = t / 1000;
+     size_t bucket = us ? log2_floor((size_t)us) + 1 : 0;
+
+     gc->stats.pause_ns += t;
+     gc->stats.last_pause_ns = t;
+     if (t > gc->stats.max_pause_ns)
+          gc->stats.max_pause_ns = t;
+     gc->stats.pauses[bucket < GC_PAUSE_BUCKETS ? bucket : GC_PAUSE_BUCKETS - 1]++;
+}
+
+/* stop at a safepoint until the collection is finished; called with
+ * the lock held */
+static void park(GarbageCollector gc) {
+     Mutator m = pthread_getspecific(gc->self);
+     jmp_buf regs;
+     if (gc->conservative && m) { /* leave references where scan_stacks finds them */
+          if (!m->stack_base)
+               m->stack_base = stack_base();
+          SPILL_REGISTERS(regs);
+          m->stack_top = FRAME_TOP(regs);
+     }
+
+     gc->nparked++;
+     pthread_cond_signal(&gc->parked);
+     while (gc->stop)
+          pthread_cond_wait(&gc->resumed,&gc->lock);
+     gc->nparked--;
+     if (m)
+          m->stack_top = NULL;
+}
+
+/* wait until all other threads have stopped at a safepoint; returns
+ * zero if another thread was collecting, which has finished when this
+ * returns */
+static int stop_world(GarbageCollector gc) {
+     if (!gc->threaded)
+          return 1;
+
+     Mutator m = pthread_getspecific(gc->self);
+     pthread_mutex_lock(&gc->lock);
+     if (gc->stop) {
+          if (m)
+               park(gc);
+          pthread_mutex_unlock(&gc->lock);
+          return 0;
+     }
+
+     __atomic_store_n(&gc->stop,1,__ATOMIC_RELEASE);
+     while (gc->nparked < gc->nthreads - (m ? 1 : 0))
+          pthread_cond_wait(&gc->parked,&gc->lock);
+     pthread_mutex_unlock(&gc->lock);
+     return 1;
+}
+
+static void resume_world(GarbageCollector gc) {
+     pause_time(gc,gc->pause_start);
+     if (!gc->threaded)
+          return;
+
+     pthread_mutex_lock(&gc->lock);
+     __atomic_store_n(&gc->stop,0,__ATOMIC_RELEASE);
+     pthread_cond_broadcast(&gc->resumed);
+     pthread_mutex_unlock(&gc->lock);
+}
+
+/* collect garbage, leaving the other threads stopped; returns zero
+ * if another thread was collecting instead */
+static int collect(GarbageCollector gc) {
+     unsigned long long start = now_ns();
+     if (!stop_world(gc))
+          return 0;
+     gc->pause_start = start;
+     if (!gc->marking) /* otherwise complete the incremental cycle */
+          start_mark(gc);
+     finish_collect(gc);
+     return 1;
+}
+
+void gc_collect(GarbageCollector gc) {
+     assert(gc);
+
+     if (collect(gc))
+          resume_world(gc);
+}
+
+int   gc_collect_step(GarbageCollector gc, size_t work) {
+     assert(gc);
+
+     if (gc->threaded) { /* marking is not safe against other threads */
+          gc_collect(gc);
+          return 1;
+     }
+
+     unsigned long long start = now_ns();
+     if (!gc->marking)
+          start_mark(gc);
+
+     drain(gc,work);
+     if (gc->nstack > 0) {
+          mark_time(gc,start);
+          pause_time(gc,start);
+          return 0;
+     }
+     mark_time(gc,start);
+
+     finish_collect(gc);
+     pause_time(gc,start);
+     return 1;
+}
+
+/* collect young garbage, leaving the other threads stopped; returns
+ * zero if another thread was collecting instead */
+static int collect_minor(GarbageCollector gc) {
+     if (!gc->generational || gc->marking)
+          return collect(gc);
+
+     unsigned long long start = now_ns();
+     if (!stop_world(gc))
+          return 0;
+     gc->pause_start = start;
+     finish_sweep(gc);
+
+     start = now_ns();
+     gc->stats.last_mark_ns = 0;
+     /* old objects are marked already, so gc_mark stops at them; young
+        objects only referenced by old ones are found through the
+        remembered set */
+     mark_roots(gc);
+     size_t i;
+     for (i = 0; i < gc->nremembered; i++) {
+          void* object = gc->remembered[i];
+          if (object_slab(object)->fixed && gc->by_layout)
+               push(gc,NULL,object,NULL);
+          else if (gc->on_mark)
+               push(gc,NULL,object,gc->on_mark);
+     }
+     drain_all(gc);
+     mark_weak(gc,0);
+     clear_weak(gc);
+     forget_samples(gc);
+     forget(gc);
+     mark_time(gc,start);
+
+     count_live(gc,1);
+     set_threshold(gc);
+     sweep_heap(gc,1);
+     gc->stats.collections++;
+     gc->stats.minor_collections++;
+     return 1;
+}
+
+void  gc_collect_minor(GarbageCollector gc) {
+     assert(gc);
+
+     if (collect_minor(gc))
+          resume_world(gc);
+}
+
+/* slab of a size class with the number of its live objects */
+struct occupant {
+     Slab slab;
+     size_t live;
+};
+
+static int by_live(const void* a, const void* b) {
+     size_t x = ((const struct occupant*)a)->live;
+     size_t y = ((const struct occupant*)b)->live;
+     return x < y ? 1 : x > y ? -1 : 0;
+}
+
+/* choose the slabs of a size class to move objects out of: the
+ * sparsest ones, as long as they are less than half full and the
+ * other slabs have room for their objects */
+static void choose_evacuated(SizeClass k) {
+     struct occupant* slabs;
+     size_t n = 0, i, w;
+     Slab s;
+
+     for (s = k->first; s; s = s->sibling)
+          n++;
+     if (n < 2)
+          return;
+
+     slabs = xmalloc(n * sizeof *slabs);
+     for (s = k->first, i = 0; s; s = s->sibling, i++) {
+          uint64_t* marks = bitmap(s,MARK_BITS);
+          slabs[i].slab = s;
+          slabs[i].live = 0;
+          for (w = 0; w < s->nwords; w++)
+               slabs[i].live += popcount64(marks[w]);
+     }
+     qsort(slabs,n,sizeof *slabs,by_live);
+
+     size_t room = 0, need = 0;
+     for (i = 0; i < n; i++)
+          room += slabs[i].slab->nobjects - slabs[i].live;
+     for (i = n; i-- > 1; ) {
+          s = slabs[i].slab;
+          room -= s->nobjects - slabs[i].live;
+          if (2 * slabs[i].live >= s->nobjects || need + slabs[i].live > room)
+               break;
+          need += slabs[i].live;
+          s->evacuating = 1;
+     }
+
+     free(slabs);
+}
+
+/* move the live objects out of the evacuated slabs of a size class
+ * into free objects of its other slabs, which have been swept. A moved
+ * object is no longer allocated in its old place and leaves its new
+ * address behind in its first word. Objects that are pinned or
+ * referenced by value stay where they are. */
+static void evacuate(GarbageCollector gc, SizeClass k) {
+     Slab s, to = k->first;
+     size_t w;
+
+     for (s = k->first; s; s = s->sibling) {
+          if (!s->evacuating)
+               continue;
+
+          uint64_t* marks = bitmap(s,MARK_BITS);
+          uint64_t* allocs = bitmap(s,ALLOC_BITS);
+          uint64_t* pins = bitmap(s,PINNED_BITS);
+          uint64_t* held = bitmap(s,HELD_BITS);
+          for (w = 0; w < s->nwords; w++) {
+               uint64_t movable;
+               for (movable = marks[w] & ~pins[w] & ~held[w]; movable; movable &= movable - 1) {
+                    uint64_t bit = movable & -movable;
+                    void* from = slab_object(s,w * 64 + ctz64(movable));
+                    void* copy = NULL;
+                    for (; to; to = to->sibling)
+                         if (!to->evacuating && (copy = slab_alloc(to)))
+                              break;
+                    if (!copy) { /* out of room: stay in place */
+                         held[w] |= bit;
+                         continue;
+                    }
+
+                    reuse(gc,to);
+                    memcpy(copy,from,s->stride);
+                    *(void**)from = copy;
+                    if (gc->generational) /* survivors are old */
+                         set_bit(to,MARK_BITS,object_index(to,copy));
+                    allocs[w] &= ~bit;
+                    marks[w] &= ~bit;
+                    gc->stats.moved++;
+               }
+          }
+     }
+}
+
+/* whether a live object has been moved by evacuate */
+static inline int moved(void* object) {
+     Slab s = object_slab(object);
+     return s->evacuating && !test_bit(s,ALLOC_BITS,object_index(s,object));
+}
+
+/* point every recorded reference to the new address of its object.
+ * A reference inside a moved object is updated in its new place. */
+static void update_slots(GarbageCollector gc) {
+     size_t i;
+     for (i = 0; i < gc->nslot_refs; i++) {
+          struct slot_ref* r = &gc->slot_refs[i];
+          void** slot = r->slot;
+          if (r->object && moved(r->object))
+               slot = (void**)(*(char**)r->object + ((char*)r->slot - (char*)r->object));
+          if (moved(*slot))
+               *slot = *(void**)*slot;
+     }
+     gc->nslot_refs = 0;
+}
+
+/* point weak references to the new addresses of moved objects */
+static void update_weak(GarbageCollector gc) {
+     size_t i;
+     for (i = 0; i < gc->nweak; i++) {
+          struct weak* w = &gc->weak[i];
+          if (w->key && moved(w->key))
+               w->key = *(void**)w->key;
+          if (w->value && moved(w->value))
+               w->value = *(void**)w->value;
+     }
+}
+
+/* follow sampled objects to their new addresses */
+static void update_samples(GarbageCollector gc) {
+     size_t i;
+     for (i = 0; i < gc->nsamples; i++)
+          if (moved(gc->samples[i].object))
+               gc->samples[i].object = *(void**)gc->samples[i].object;
+}
+
+void  gc_compact(GarbageCollector gc) {
+     assert(gc);
+
+     unsigned long long start = now_ns();
+     while (!stop_world(gc)) /* another thread collected: compact after it */
+          ;
+     gc->pause_start = start;
+     if (gc->marking) /* complete the incremental cycle */
+          finish_collect(gc);
+     finish_sweep(gc);
+
+     /* let threads claim new slabs, so any slab can be evacuated */
+     Mutator m;
+     size_t c;
+     for (m = gc->mutators; m; m = m->next)
+          for (c = 0; c < NCLASSES; c++)
+               if (m->current[c]) {
+                    m->current[c]->owner = NULL;
+                    m->current[c] = NULL;
+               }
+
+     /* mark serially, recording the slots given to gc_mark_slot */
+     start = now_ns();
+     gc->stats.last_mark_ns = 0;
+     clear_marks(gc);
+     gc->compacting = 1;
+     gc->tracing = NULL;
+     mark_roots(gc);
+     drain(gc,(size_t)-1);
+     mark_weak(gc,1);
+     clear_weak(gc);
+     forget_samples(gc);
+     gc->compacting = 0;
+     forget(gc);
+     mark_time(gc,start);
+     count_live(gc,0);
+     set_threshold(gc);
+
+     /* moved objects need room for a forwarding address */
+     for (c = 0; c < LARGE; c++)
+          if (gc->classes[c].stride >= sizeof(void*))
+               choose_evacuated(&gc->classes[c]);
+
+     /* sweep the slabs objects are moved into first, then the
+        evacuated ones once no reference to them is left */
+     Slab s;
+     __atomic_store_n(&gc->stats.last_reclaimed,0,__ATOMIC_RELAXED);
+     for (s = gc->slabs; s; s = s->next)
+          if (!s->evacuating)
+               sweep(gc,s);
+     for (c = 0; c < LARGE; c++)
+          evacuate(gc,&gc->classes[c]);
+     update_slots(gc);
+     update_weak(gc);
+     update_samples(gc);
+     for (s = gc->slabs; s; s = s->next) {
+          if (s->evacuating)
+               sweep(gc,s);
+          s->evacuating = 0;
+          memset(bitmap(s,HELD_BITS),0,s->nwords * sizeof(uint64_t));
+          if (gc->generational) /* objects changed slabs */
+               recount(gc,s);
+     }
+
+     for (c = 0; c < NCLASSES; c++)
+          gc->classes[c].current = gc->classes[c].first;
+     gc->stats.collections++;
+     resume_world(gc);
+}
+
+/* heap images, see gc_save_image: a header, a table of the saved
+ * slabs, the addresses of all references between saved objects and
+ * the slabs themselves, each starting on a page boundary so it can be
+ * mapped directly. Addresses are those at the time of saving; an image
+ * is only relocated if its slabs cannot be mapped there again. */
+static const char image_magic[8] = "simplegc";
+#define IMAGE_VERSION 1
+
+struct image_header {
+     char magic[8];
+     uint32_t version;
+     uint32_t word_size;   /* sizeof(void*) of the saving process */
+     uint64_t page_size;   /* page size slabs are aligned to in the file */
+     uint64_t slab_size;   /* sizeof(struct slab), to reject other builds */
+     uint64_t object_size; /* stride of the objects of gc_alloc */
+     uint64_t nslabs;      /* entries of the slab table */
+     uint64_t nslots;      /* references to relocate */
+     uint64_t root;        /* address of the root object */
+};
+
+struct image_slab {
+     uint64_t address;     /* address of the slab when it was saved */
+     uint64_t offset;      /* position of the slab in the file */
+     uint64_t bytes;       /* size of the slab */
+     uint64_t sizeclass;   /* index into the size classes */
+};
+
+static int write_all(int fd, const void* buffer, size_t n) {
+     const char* p = buffer;
+     while (n > 0) {
+          ssize_t k = write(fd,p,n);
+          if (k < 0 && errno != EINTR)
+               return -1;
+          if (k > 0) {
+               p += k;
+               n -= (size_t)k;
+          }
+     }
+     return 0;
+}
+
+static int read_all(int fd, void* buffer, size_t n) {
+     char* p = buffer;
+     while (n > 0) {
+          ssize_t k = read(fd,p,n);
+          if (k == 0)
+               errno = EINVAL; /* truncated image */
+          if (k == 0 || (k < 0 && errno != EINTR))
+               return -1;
+          if (k > 0) {
+               p += k;
+               n -= (size_t)k;
+          }
+     }
+     return 0;
+}
+
+static int by_address(const void* a, const void* b) {
+     uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+     return (x > y) - (x < y);
+}
+
+/* write the slabs holding marked objects, with the marked objects as
+ * the only allocated ones */
+static int write_slabs(int fd, struct image_slab* table, size_t nslabs) {
+     size_t i;
+     for (i = 0; i < nslabs; i++) {
+          Slab s = (Slab)(uintptr_t)table[i].address;
+          size_t head = slab_header(s->capacity);
+          char* copy = xmalloc(head);
+          memcpy(copy,s,head);
+          uint64_t* bits = (uint64_t*)((Slab)copy + 1);
+          memset(bits,0,NBITMAPS * s->nwords * sizeof(uint64_t));
+          memcpy(bits + ALLOC_BITS * s->nwords,bitmap(s,MARK_BITS),s->nwords * sizeof(uint64_t));
+
+          int failed = lseek(fd,(off_t)table[i].offset,SEEK_SET) < 0
+               || write_all(fd,copy,head) < 0
+               || write_all(fd,s->objects,s->bytes - head) < 0;
+          free(copy);
+          if (failed)
+               return -1;
+     }
+     return 0;
+}
+
+int   gc_save_image(GarbageCollector gc, const char* path, void* root) {
+     assert(gc);
+     assert(path);
+     assert(root);
+
+     /* write a new file and rename it, so processes that mapped an
+        older image at the same path keep using that */
+     size_t length = strlen(path);
+     char* temp = xmalloc(length + sizeof ".XXXXXX");
+     memcpy(temp,path,length);
+     memcpy(temp + length,".XXXXXX",sizeof ".XXXXXX");
+     int fd = mkstemp(temp);
+     if (fd < 0) {
+          free(temp);
+          return -1;
+     }
+     fchmod(fd,0644);
+
+     unsigned long long start = now_ns();
+     while (!stop_world(gc)) /* another thread collected: save after it */
+          ;
+     gc->pause_start = start;
+     if (gc->marking) /* complete the incremental cycle */
+          finish_collect(gc);
+     finish_sweep(gc);
+
+     /* set the marks of the heap aside and mark what root references,
+        recording the slots given to gc_mark_slot */
+     Slab s;
+     size_t nwords = 0, i, k;
+     for (s = gc->slabs; s; s = s->next)
+          nwords += s->nwords;
+     uint64_t* marks = xmalloc(nwords * sizeof *marks);
+     for (k = 0, s = gc->slabs; s; k += s->nwords, s = s->next)
+          memcpy(marks + k,bitmap(s,MARK_BITS),s->nwords * sizeof *marks);
+     clear_marks(gc);
+     gc->compacting = 1;
+     gc->tracing = NULL;
+     mark_slot(NULL,gc->on_mark,&root);
+     drain(gc,(size_t)-1);
+     gc->compacting = 0;
+
+     /* slabs in the image, by address */
+     sort_ranges(gc);
+     struct image_slab* table = xmalloc((gc->nranges + 1) * sizeof *table);
+     size_t nslabs = 0, held = 0;
+     for (i = 0; i < gc->nranges; i++) {
+          s = gc->ranges[i];
+          size_t live = 0;
+          for (k = 0; k < s->nwords; k++) {
+               live += popcount64(bitmap(s,MARK_BITS)[k]);
+               held += popcount64(bitmap(s,HELD_BITS)[k]);
+          }
+          if (live) {
+               table[nslabs].address = (uint64_t)(uintptr_t)s;
+               table[nslabs].bytes = s->bytes;
+               table[nslabs].sizeclass = slab_class(s);
+               nslabs++;
+          }
+     }
+
+     /* references from saved objects, without the slot of root */
+     uint64_t* slots = xmalloc((gc->nslot_refs + 1) * sizeof *slots);
+     size_t nslots = 0;
+     for (i = 0; i < gc->nslot_refs; i++)
+          if (gc->slot_refs[i].object)
+               slots[nslots++] = (uint64_t)(uintptr_t)gc->slot_refs[i].slot;
+     qsort(slots,nslots,sizeof *slots,by_address);
+     for (i = 0, k = 0; i < nslots; i++) /* a slot may be traced twice */
+          if (k == 0 || slots[k - 1] != slots[i])
+               slots[k++] = slots[i];
+     nslots = k;
+
+     struct image_header h;
+     memset(&h,0,sizeof h);
+     memcpy(h.magic,image_magic,sizeof h.magic);
+     h.version = IMAGE_VERSION;
+     h.word_size = sizeof(void*);
+     h.page_size = page_size();
+     h.slab_size = sizeof(struct slab);
+     h.object_size = gc->classes[FIXED].stride;
+     h.nslabs = nslabs;
+     h.nslots = nslots;
+     h.root = (uint64_t)(uintptr_t)root;
+     size_t offset = align_up(sizeof h + nslabs * sizeof *table + nslots * sizeof *slots,page_size());
+     for (i = 0; i < nslabs; i++) {
+          table[i].offset = offset;
+          offset += table[i].bytes;
+     }
+
+     /* references marked by value cannot be relocated */
+     int result = -1;
+     if (held)
+          errno = EINVAL;
+     else if (write_all(fd,&h,sizeof h) == 0
+              && write_all(fd,table,nslabs * sizeof *table) == 0
+              && write_all(fd,slots,nslots * sizeof *slots) == 0
+              && write_slabs(fd,table,nslabs) == 0)
+          result = 0;
+
+     for (k = 0, s = gc->slabs; s; k += s->nwords, s = s->next) {
+          memcpy(bitmap(s,MARK_BITS),marks + k,s->nwords * sizeof *marks);
+          memset(bitmap(s,HELD_BITS),0,s->nwords * sizeof(uint64_t));
+     }
+     gc->nslot_refs = 0;
+     resume_world(gc);
+
+     free(marks);
+     free(table);
+     free(slots);
+     if (close(fd) < 0 || (result == 0 && rename(temp,path) < 0))
+          result = -1;
+     if (result < 0) {
+          int error = errno;
+          unlink(temp);
+          errno = error;
+     }
+     free(temp);
+     return result;
+}
+
+/* map a slab of an image, at the address it was saved from if that is
+ * free; returns NULL if it cannot be mapped */
+static Slab map_image_slab(int fd, const struct image_slab* is) {
+     void* want = (void*)(uintptr_t)is->address;
+     int flags = MAP_PRIVATE;
+#ifdef MAP_FIXED_NOREPLACE
+     flags |= MAP_FIXED_NOREPLACE;
+#endif
+     void* s = mmap(want,is->bytes,PROT_READ | PROT_WRITE,flags,fd,(off_t)is->offset);
+     if (s == want)
+          return s;
+     if (s != MAP_FAILED) /* only a hint to this kernel */
+          unmap(s,is->bytes);
+
+     s = map_aligned(is->bytes);
+     if (!s)
+          return NULL;
+     if (mmap(s,is->bytes,PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_FIXED,fd,(off_t)is->offset) == MAP_FAILED) {
+          unmap(s,is->bytes);
+          return NULL;
+     }
+     return s;
+}
+
+/* the address of a saved address in the mapped image, or 0 if it is
+ * outside of all saved slabs */
+static uint64_t relocate(const struct image_slab* table, Slab* slabs, size_t n, uint64_t address) {
+     size_t lo = 0, hi = n;
+     while (lo < hi) {
+          size_t mid = lo + (hi - lo) / 2;
+          if (table[mid].address <= address)
+               lo = mid + 1;
+          else
+               hi = mid;
+     }
+     if (lo == 0 || address - table[lo - 1].address >= table[lo - 1].bytes)
+          return 0;
+     return (uint64_t)(uintptr_t)slabs[lo - 1] + (address - table[lo - 1].address);
+}
+
+/* read the header, slab table and references of an image, checking
+ * it was written by this build for a collector like gc */
+static int read_image(GarbageCollector gc, int fd, struct image_header* h,
+                      struct image_slab** table, uint64_t** slots) {
+     struct stat st;
+     if (read_all(fd,h,sizeof *h) < 0 || fstat(fd,&st) < 0)
+          return -1;
+     if (memcmp(h->magic,image_magic,sizeof h->magic) || h->version != IMAGE_VERSION
+         || h->word_size != sizeof(void*) || h->page_size != page_size()
+         || h->slab_size != sizeof(struct slab)
+         || h->object_size != gc->classes[FIXED].stride
+         || h->nslabs > (uint64_t)st.st_size / sizeof **table
+         || h->nslots > (uint64_t)st.st_size / sizeof **slots) {
+          errno = EINVAL;
+          return -1;
+     }
+
+     size_t i;
+     *table = xmalloc((h->nslabs + 1) * sizeof **table);
+     *slots = xmalloc((h->nslots + 1) * sizeof **slots);
+     if (read_all(fd,*table,h->nslabs * sizeof **table) < 0
+         || read_all(fd,*slots,h->nslots * sizeof **slots) < 0)
+          return -1;
+     for (i = 0; i < h->nslabs; i++) {
+          struct image_slab* is = &(*table)[i];
+          if (is->address % GC_SLAB_ALIGN || is->offset % page_size()
+              || is->bytes == 0 || is->bytes % page_size()
+              || is->offset + is->bytes > (uint64_t)st.st_size
+              || is->sizeclass >= NCLASSES
+              || (i > 0 && is->address < is[-1].address + is[-1].bytes)) {
+               errno = EINVAL;
+               return -1;
+          }
+     }
+     return 0;
+}
+
+/* check that a mapped slab is one gc could have created */
+static int valid_slab(GarbageCollector gc, Slab s, const struct image_slab* is) {
+     if (s->bytes != is->bytes || s->capacity == 0 || s->nobjects > s->capacity
+         || s->nwords != (s->capacity + 63) / 64
+         || slab_header(s->capacity) + s->capacity * s->stride > s->bytes)
+          return 0;
+     if (is->sizeclass == LARGE)
+          return s->capacity == 1;
+     return s->stride == gc->classes[is->sizeclass].stride;
+}
+
+/* add a mapped slab of an image to the heap; its objects are young */
+static void adopt_slab(GarbageCollector gc, SizeClass c, Slab s) {
+     size_t w, allocated = 0;
+     s->bits = (uint64_t*)(s + 1);
+     s->objects = (char*)s + slab_header(s->capacity);
+     for (w = 0; w < s->nwords; w++)
+          allocated += popcount64(bitmap(s,ALLOC_BITS)[w]);
+
+     s->next = NULL;
+     s->sibling = NULL;
+     s->gc = gc;
+     s->owner = NULL;
+     s->nfree = s->nobjects - allocated;
+     s->cursor = 0;
+     s->unswept = SWEPT;
+     s->young = 1;
+     s->evacuating = 0;
+     s->empty = 0;
+     s->released = 0;
+     s->marked = 0;
+     s->backing = 0;
+     s->chunked = 0;
+     link_slab(gc,c,s);
+}
+
+/* map the slabs of an image, counting them in nmapped; returns zero
+ * if all of them are mapped and valid */
+static int map_image(GarbageCollector gc, int fd, const struct image_header* h,
+                     const struct image_slab* table, Slab* slabs, size_t* nmapped) {
+     size_t i;
+     for (i = 0; i < h->nslabs; i++) {
+          Slab s = map_image_slab(fd,&table[i]);
+          if (!s)
+               return -1;
+          slabs[i] = s;
+          *nmapped = i + 1;
+          if (!valid_slab(gc,s,&table[i])) {
+               errno = EINVAL;
+               return -1;
+          }
+     }
+     return 0;
+}
+
+/* point the references of an image at the mapped slabs; returns the
+ * address of the root object, or NULL if the image is corrupt */
+static void* relocate_image(const struct image_header* h, const struct image_slab* table,
+                            const uint64_t* slots, Slab* slabs) {
+     size_t i;
+     int moved = 0;
+     for (i = 0; i < h->nslabs; i++)
+          moved |= (uint64_t)(uintptr_t)slabs[i] != table[i].address;
+
+     /* pages of slabs mapped where they were saved are left untouched,
+        so they stay shared with every other process mapping the image */
+     for (i = 0; moved && i < h->nslots; i++) {
+          uint64_t slot = relocate(table,slabs,h->nslabs,slots[i]);
+          if (!slot || slot % sizeof(void*)) {
+               errno = EINVAL;
+               return NULL;
+          }
+          void** p = (void**)(uintptr_t)slot;
+          uint64_t object = relocate(table,slabs,h->nslabs,(uint64_t)(uintptr_t)*p);
+          if (!object) {
+               errno = EINVAL;
+               return NULL;
+          }
+          *p = (void*)(uintptr_t)object;
+     }
+
+     void* root = (void*)(uintptr_t)relocate(table,slabs,h->nslabs,h->root);
+     if (!root)
+          errno = EINVAL;
+     return root;
+}
+
+void* gc_load_image(GarbageCollector gc, const char* path) {
+     assert(gc);
+     assert(path);
+
+     int fd = open(path,O_RDONLY);
+     if (fd < 0)
+          return NULL;
+
+     struct image_header h;
+     struct image_slab* table = NULL;
+     uint64_t* slots = NULL;
+     Slab* slabs = NULL;
+     size_t nmapped = 0, i;
+     void* root = NULL;
+     if (read_image(gc,fd,&h,&table,&slots) == 0) {
+          slabs = xmalloc((h.nslabs + 1) * sizeof *slabs);
+          if (map_image(gc,fd,&h,table,slabs,&nmapped) == 0)
+               root = relocate_image(&h,table,slots,slabs);
+     }
+
+     if (root) {
+          lock(gc);
+          for (i = 0; i < nmapped; i++)
+               adopt_slab(gc,&gc->classes[table[i].sizeclass],slabs[i]);
+          unlock(gc);
+     }
+     else {
+          int error = errno;
+          for (i = 0; i < nmapped; i++)
+               unmap(slabs[i],table[i].bytes);
+          errno = error;
+     }
+
+     free(table);
+     free(slots);
+     free(slabs);
+     close(fd);
+     return root;
+}
+
+void  gc_set_generational(GarbageCollector gc, int generational) {
+     assert(gc);
+
+     if (gc->marking)
+          gc_collect(gc);
+     finish_sweep(gc);
+     if (generational) { /* every object is young until it survives */
+          Slab s;
+          for (s = gc->slabs; s ; s = s->next)
+               s->young = 1;
+     }
+     else {
+          clear_marks(gc);
+          forget(gc);
+     }
+     gc->generational = generational;
+}
+
+size_t gc_run_finalizers(GarbageCollector gc, size_t max) {
+     assert(gc);
+     void* batch[FINALIZE_BATCH];
+     size_t done = 0, n, i;
+     Mutator m = self(gc);
+
+     if (!gc->finalizers)
+          return 0;
+
+     for (; done < max; done += n) {
+          pthread_mutex_lock(&gc->finalize_lock);
+          for (n = 0; n < FINALIZE_BATCH && done + n < max && gc->nfinalize > 0; n++)
+               batch[n] = gc->finalize[--gc->nfinalize];
+          pthread_mutex_unlock(&gc->finalize_lock);
+          if (!n)
+               break;
+
+          /* a collection during the finalizers still traces the batch */
+          if (m) {
+               m->finalizing = batch;
+               m->nfinalizing = n;
+          }
+          if (gc->on_collect_batch)
+               gc->on_collect_batch(batch,n);
+          else if (gc->on_collect)
+               for (i = 0; i < n; i++)
+                    gc->on_collect(batch[i]);
+          if (m)
+               m->nfinalizing = 0;
+
+          /* the next sweep of their slabs frees them */
+          for (i = 0; i < n; i++) {
+               Slab s = object_slab(batch[i]);
+               size_t j = object_index(s,batch[i]);
+               __atomic_fetch_or(bitmap(s,FINALIZED_BITS) + j / 64,(uint64_t)1 << (j % 64),__ATOMIC_RELEASE);
+          }
+     }
+
+     return done;
+}
+
+/* finalize some queued objects on the way to a new slab */
+static inline void finalize_some(GarbageCollector gc) {
+     if (gc->finalize_per_alloc)
+          gc_run_finalizers(gc,gc->finalize_per_alloc);
+}
+
+void  gc_set_profiling(GarbageCollector gc, size_t sample_bytes) {
+     assert(gc);
+
+     if (!gc->profiled) {
+          pthread_mutex_init(&gc->profile_lock,NULL);
+          gc->profiled = 1;
+     }
+     pthread_mutex_lock(&gc->profile_lock);
+     /* read by allocating threads without the lock */
+     __atomic_store_n(&gc->sample_bytes,sample_bytes,__ATOMIC_RELAXED);
+     if (!sample_bytes)
+          clear_profile(gc);
+     pthread_mutex_unlock(&gc->profile_lock);
+}
+
+/* write the name of a frame from backtrace_symbols, e.g.
+ * "prog(main+0x1d) [0x55d0c1a2b1d9]" is written as "main" and a frame
+ * without symbol, "prog(+0x11d9) [0x55d0c1a2b1d9]", as "prog+0x11d9" */
+static int write_frame(FILE* out, const char* symbol) {
+     const char* open = strchr(symbol,'(');
+     const char* end = open ? strpbrk(open,"+)") : NULL;
+     if (!open || !end) /* no parentheses: write it as it is, without spaces */
+          return fprintf(out,"%.*s",(int)strcspn(symbol," ;"),symbol);
+     if (end > open + 1)
+          return fprintf(out,"%.*s",(int)(end - open - 1),open + 1);
+
+     const char* name = symbol;
+     const char* slash;
+     while ((slash = strchr(name,'/')) && slash < open)
+          name = slash + 1;
+     const char* close = strchr(end,')');
+     return fprintf(out,"%.*s%.*s",(int)(open - name),name,
+                    (int)(close ? close - end : 0),end);
+}
+
+int   gc_write_profile(GarbageCollector gc, FILE* out, int kind) {
+     assert(gc);
+     assert(out);
+     assert(kind == GC_PROFILE_LIVE || kind == GC_PROFILE_ALLOCATED);
+
+     if (!gc->profiled)
+          return 0;
+
+     size_t i, j;
+     pthread_mutex_lock(&gc->profile_lock);
+     for (i = 0; i < gc->nsites; i++) {
+          struct site* s = &gc->sites[i];
+          unsigned long long bytes = kind == GC_PROFILE_LIVE ? s->live_bytes : s->allocated_bytes;
+          if (!bytes)
+               continue;
+
+          /* folded stacks list the outermost frame first */
+          char** symbols = NULL;
+#ifdef HAVE_BACKTRACE
+          symbols = backtrace_symbols(s->frames,(int)s->nframes);
+#endif
+          for (j = s->nframes; j-- > 0; ) {
+               if (symbols)
+                    write_frame(out,symbols[j]);
+               else
+                    fprintf(out,"%p",s->frames[j]);
+               fputc(j ? ';' : ' ',out);
+          }
+          if (!s->nframes)
+               fputs("[unknown] ",out);
+          fprintf(out,"%llu\n",bytes);
+          free(symbols);
+     }
+     pthread_mutex_unlock(&gc->profile_lock);
+
+     return ferror(out) ? -1 : 0;
+}
+
+void  gc_set_deferred_finalization(GarbageCollector gc, int deferred, size_t per_alloc, gc_batch_fn on_collect_batch) {
+     assert(gc);
+
+     if (gc->marking)
+          gc_collect(gc);
+     finish_sweep(gc);
+     if (!gc->finalizers) {
+          pthread_mutex_init(&gc->finalize_lock,NULL);
+          gc->finalizers = 1;
+     }
+
+     gc->deferred = deferred;
+     gc->finalize_per_alloc = deferred ? per_alloc : 0;
+     gc->on_collect_batch = on_collect_batch;
+     if (!deferred) /* nothing is queued anymore, finalize what is left */
+          gc_run_finalizers(gc,(size_t)-1);
+}
+
+void  gc_set_conservative(GarbageCollector gc, int conservative) {
+     assert(gc);
+
+     lock(gc);
+     gc->conservative = conservative;
+     unlock(gc);
+}
+
+void  gc_set_layout(GarbageCollector gc, const size_t* offsets, size_t n) {
+     assert(gc);
+     assert(offsets || !n);
+     size_t i;
+
+     if (gc->marking)
+          gc_collect(gc);
+
+     free(gc->layout);
+     gc->layout = NULL;
+     gc->nlayout = 0;
+     gc->by_layout = offsets != NULL;
+     if (!n)
+          return;
+
+     gc->layout = xmalloc(n * sizeof *gc->layout);
+     for (i = 0; i < n; i++) {
+          assert(offsets[i] + sizeof(void*) <= gc->size);
+          gc->layout[i] = offsets[i];
+     }
+     gc->nlayout = n;
+}
+
+void gc_set_lazy_sweep(GarbageCollector gc, int lazy) {
+     assert(gc);
+
+     if (!lazy)
+          finish_sweep(gc);
+     gc->lazy = lazy;
+}
+
+void  gc_set_growth(GarbageCollector gc, double occupancy, size_t min_heap, size_t max_heap) {
+     assert(gc);
+     assert(occupancy > 0 && occupancy < 1);
+
+     lock(gc);
+     gc->growing = 1;
+     gc->occupancy = occupancy;
+     gc->min_heap = min_heap;
+     gc->max_heap = max_heap ? max_heap : (size_t)-1;
+     gc->threshold = min_heap;
+     unlock(gc);
+}
+
+void  gc_set_backing(GarbageCollector gc, int pages, int node) {
+     assert(gc);
+     assert(pages >= GC_PAGES_DEFAULT && pages <= GC_PAGES_HUGE);
+     assert(node >= GC_NODE_INTERLEAVE && node < MAX_NODES);
+
+     lock(gc);
+     gc->pages = pages;
+     gc->node = node;
+     memset(gc->nodes,0,sizeof gc->nodes);
+     if (node >= 0)
+          gc->nodes[node / (8 * sizeof(unsigned long))] = 1UL << (node % (8 * sizeof(unsigned long)));
+#if defined(__linux__) && defined(SYS_get_mempolicy)
+     else if (node == GC_NODE_INTERLEAVE) /* all nodes the process may use */
+          syscall(SYS_get_mempolicy,NULL,gc->nodes,(unsigned long)MAX_NODES + 1,NULL,
+                  (unsigned long)MEMS_ALLOWED);
+#endif
+     /* a huge page per slab */
+     gc->slab_size = pages != GC_PAGES_DEFAULT ? GC_SLAB_ALIGN : gc->chosen_slab_size;
+     unlock(gc);
+}
+
+void  gc_set_release(GarbageCollector gc, size_t retain, unsigned cycles) {
+     assert(gc);
+
+     lock(gc);
+     gc->retain = retain;
+     gc->release_cycles = cycles;
+     unlock(gc);
+}
+
+void  gc_set_background_sweep(GarbageCollector gc, int background) {
+     assert(gc);
+
+     if (!background == !gc->background)
+          return;
+
+     if (background) {
+          pthread_mutex_init(&gc->sweep_lock,NULL);
+          pthread_cond_init(&gc->sweep_start,NULL);
+          pthread_cond_init(&gc->swept,NULL);
+          gc->sweep_cycle = 0;
+          gc->sweep_quit = 0;
+          if (pthread_create(&gc->sweeper,NULL,sweeper_main,gc) != 0) {
+               fputs("gc: cannot create sweeping thread.\n",stderr);
+               abort();
+          }
+          gc->background = 1;
+          return;
+     }
+
+     finish_sweep(gc);
+     pthread_mutex_lock(&gc->sweep_lock);
+     gc->sweep_quit = 1;
+     pthread_cond_signal(&gc->sweep_start);
+     pthread_mutex_unlock(&gc->sweep_lock);
+     pthread_join(gc->sweeper,NULL);
+
+     pthread_mutex_destroy(&gc->sweep_lock);
+     pthread_cond_destroy(&gc->sweep_start);
+     pthread_cond_destroy(&gc->swept);
+     gc->background = 0;
+}
+
+void  gc_safepoint(GarbageCollector gc) {
+     assert(gc);
+
+     if (gc->threaded && __atomic_load_n(&gc->stop,__ATOMIC_ACQUIRE)) {
+          pthread_mutex_lock(&gc->lock);
+          park(gc);
+          pthread_mutex_unlock(&gc->lock);
+     }
+}
+
+void  gc_set_threaded(GarbageCollector gc) {
+     assert(gc);
+
+     if (gc->threaded)
+          return;
+
+     pthread_key_create(&gc->self,NULL);
+     pthread_mutex_init(&gc->lock,NULL);
+     pthread_cond_init(&gc->parked,NULL);
+     pthread_cond_init(&gc->resumed,NULL);
+     pthread_setspecific(gc->self,&gc->main);
+     gc->nthreads = 1;
+     gc->threaded = 1;
+}
+
+void  gc_thread_attach(GarbageCollector gc) {
+     assert(gc);
+     assert(gc->threaded);
+
+     Mutator m = xmalloc(sizeof *m);
+     pthread_setspecific(gc->self,m);
+
+     pthread_mutex_lock(&gc->lock);
+     /* a running collection walks the thread list without the lock */
+     while (gc->stop)
+          pthread_cond_wait(&gc->resumed,&gc->lock);
+     m->next = gc->mutators;
+     gc->mutators = m;
+     gc->nthreads++;
+     pthread_mutex_unlock(&gc->lock);
+}
+
+void  gc_thread_detach(GarbageCollector gc) {
+     assert(gc);
+     assert(gc->threaded);
+
+     Mutator m = pthread_getspecific(gc->self);
+     assert(m);
+     assert(m->nframes == 0);
+
+     pthread_mutex_lock(&gc->lock);
+     if (gc->stop) /* let a running collection finish first */
+          park(gc);
+     Mutator* cur;
+     for (cur = &gc->mutators; *cur != m; cur = &(*cur)->next)
+          ;
+     *cur = m->next;
+     gc->nthreads--;
+     size_t c;
+     for (c = 0; c < NCLASSES; c++)
+          if (m->current[c])
+               m->current[c]->owner = NULL;
+     pthread_cond_signal(&gc->parked); /* one thread less to wait for */
+     pthread_mutex_unlock(&gc->lock);
+
+     pthread_setspecific(gc->self,NULL);
+     free(m->frames);
+     m->frames = NULL;
+     m->frames_size = 0;
+     if (m != &gc->main)
+          free(m);
+}
+
+/* whether the heap may grow by bytes: up to the collection threshold,
+ * and up to the maximum heap size if force is set, i.e. when
+ * collecting did not help. Released slabs do not count, so memory
+ * given back by one size class can be used by another. Each size
+ * class holds whole slabs, so a class can run out while the others
+ * keep the heap above the threshold; it still grows as long as the
+ * live bytes and the objects handed out since the collection stay
+ * below the threshold. */
+static int may_grow(GarbageCollector gc, size_t bytes, int force) {
+     size_t heap = gc->mapped - __atomic_load_n(&gc->idle,__ATOMIC_RELAXED);
+     if (heap + bytes > gc->max_heap)
+          return 0;
+     return force || heap + bytes <= gc->threshold
+          || gc->stats.live_bytes + gc->handed + bytes <= gc->threshold;
+}
+
+/* hand the next slab of a size class nobody is allocating from to a
+ * thread; returns zero if every slab has been handed out since the
+ * last collection */
+static int claim(GarbageCollector gc, Mutator m, size_t c) {
+     lock(gc);
+     Slab s = gc->classes[c].current;
+     for (; s; s = s->sibling) { /* skip slabs in use and full ones */
+          if (s->owner)
+               continue;
+          /* the sweeper sets released, so read it once the slab is swept */
+          sweep_pending(gc,s);
+          if (!s->nfree)
+               continue;
+          if (s->released && !may_grow(gc,s->bytes,1))
+               continue; /* its memory would exceed max_heap */
+          break;
+     }
+     if (s) {
+          gc->classes[c].current = s->sibling;
+          gc->handed += s->nfree * s->stride;
+          reuse(gc,s);
+          if (m->current[c])
+               m->current[c]->owner = NULL;
+          s->owner = m;
+          m->current[c] = s;
+     }
+     unlock(gc);
+
+     return s != NULL;
+}
+
+/* map another slab for a size class if the heap may grow */
+static int grow(GarbageCollector gc, size_t c, int force) {
+     lock(gc);
+     int grown = may_grow(gc,gc->slab_size,force);
+     if (grown) {
+          SizeClass k = &gc->classes[c];
+          Slab s = add_slab(gc,k,gc->slab_size,k->stride);
+          carve(s,s->capacity);
+          gc->handed += s->capacity * s->stride;
+     }
+     unlock(gc);
+
+     return grown;
+}
+
+/* collect before the heap runs out of objects; returns zero once every
+ * kind of collection has been tried. A collection of another thread
+ * does not count. The collecting thread takes a slab with free objects
+ * of class c for m, if given, before the other threads resume, so
+ * they cannot take all of them first. */
+static int reclaim(GarbageCollector gc, Mutator m, size_t c, int* collected) {
+     int done;
+     if (!*collected) /* try to reclaim unused objects, only young ones first */
+          done = collect_minor(gc);
+     else if (*collected == 1 && gc->generational)
+          done = collect(gc);
+     else
+          return 0;
+
+     if (done) {
+          (*collected)++;
+          if (m && !(m->current[c] && m->current[c]->nfree))
+               claim(gc,m,c);
+          resume_world(gc);
+     }
+     return 1;
+}
+
+/* take an object of a size class, growing the heap or collecting if
+ * there is none; FIXED only grows after gc_set_growth */
+static void* alloc(GarbageCollector gc, size_t c) {
+     gc_safepoint(gc);
+     Mutator m = self(gc);
+     assert(m);
+
+     void* object = NULL;
+     int collected = 0;
+     while (!m->current[c] || !(object = slab_alloc(m->current[c]))) {
+          finalize_some(gc);
+          if (claim(gc,m,c))
+               continue;
+          if ((c != FIXED || gc->growing) && grow(gc,c,collected))
+               continue;
+          if (!reclaim(gc,m,c,&collected))
+               return NULL; /* no objects available */
+     }
+
+     if (gc->marking) /* allocate black during an incremental mark */
+          set_mark(object);
+     m->current[c]->young = 1;
+
+     return object;
+}
+
+/* objects larger than every size class get a slab of their own */
+static void* alloc_large(GarbageCollector gc, size_t n) {
+     gc_safepoint(gc);
+     finalize_some(gc);
+
+     /* the slab, rounded up to whole pages or huge pages, must not
+        overflow a size_t */
+     if (n > (size_t)-1 - slab_header(1) - 2 * GC_SLAB_ALIGN)
+          return NULL;
+
+     /* slabs of freed large objects are unmapped, so there is none to
+        reuse */
+     size_t stride = align_up(n,page_size());
+     void* object = NULL;
+     int collected = 0, mapped = 1;
+     do {
+          lock(gc);
+          if (may_grow(gc,align_up(slab_header(1) + stride,page_size()),collected)) {
+               /* too large for a slab of slab_size, so slab() sizes it */
+               Slab s = slab(gc,0,stride);
+               if (s) {
+                    link_slab(gc,&gc->classes[LARGE],s);
+                    carve(s,1);
+                    object = slab_alloc(s);
+                    gc->handed += stride;
+               }
+               mapped = s != NULL;
+          }
+          unlock(gc);
+     } while (!object && mapped && reclaim(gc,NULL,LARGE,&collected));
+
+     if (object) {
+          if (gc->marking)
+               set_mark(object);
+          object_slab(object)->young = 1;
+     }
+
+     return object;
+}
+
+void* gc_alloc(GarbageCollector gc) {
+     assert(gc);
+
+     void* object = alloc(gc,FIXED);
+     if (profiling(gc) && object)
+          profile(gc,object,gc->size,CALLER());
+     return object;
+}
+
+size_t gc_alloc_n(GarbageCollector gc, size_t n, void** objects) {
+     assert(gc);
+     assert(objects || !n);
+
+     gc_safepoint(gc);
+     Mutator m = self(gc);
+     assert(m);
+
+     size_t k = 0, i;
+     int collected = 0;
+     while (k < n) {
+          Slab s = m->current[FIXED];
+          if (s) {
+               size_t taken = slab_alloc_n(s,objects + k,n - k);
+               if (taken && gc->marking) /* allocate black during an incremental mark */
+                    for (i = k; i < k + taken; i++)
+                         set_mark(objects[i]);
+               if (taken)
+                    s->young = 1;
+               k += taken;
+               if (k == n)
+                    break;
+          }
+          finalize_some(gc);
+          if (claim(gc,m,FIXED))
+               continue;
+          if (gc->growing && grow(gc,FIXED,collected))
+               continue;
+          if (collected)
+               break; /* collect once at most */
+
+          /* the objects taken so far are not referenced yet */
+          m->batch = objects;
+          m->nbatch = k;
+          int done = reclaim(gc,m,FIXED,&collected);
+          m->nbatch = 0;
+          if (!done)
+               break;
+     }
+
+     if (profiling(gc))
+          for (i = 0; i < k; i++)
+               profile(gc,objects[i],gc->size,CALLER());
+     return k;
+}
+
+void* gc_alloc_size(GarbageCollector gc, size_t n) {
+     assert(gc);
+
+     void* object = n > MAX_CLASS_SIZE ? alloc_large(gc,n) : alloc(gc,1 + size_class(n));
+     if (profiling(gc) && object)
+          profile(gc,object,n,CALLER());
+     return object;
+}
+
+void  gc_stats(GarbageCollector gc, struct gc_stats* stats) {
+     assert(gc);
+     assert(stats);
 
-     return (n+1); /* address of object without header */
+     lock(gc);
+     *stats = gc->stats;
+     stats->swept = __atomic_load_n(&gc->stats.swept,__ATOMIC_RELAXED);
+     stats->reclaimed = __atomic_load_n(&gc->stats.reclaimed,__ATOMIC_RELAXED);
+     stats->last_reclaimed = __atomic_load_n(&gc->stats.last_reclaimed,__ATOMIC_RELAXED);
+     stats->sweep_ns = __atomic_load_n(&gc->stats.sweep_ns,__ATOMIC_RELAXED);
+     stats->released_bytes = __atomic_load_n(&gc->stats.released_bytes,__ATOMIC_RELAXED);
+     stats->heap_bytes = gc->mapped;
+     unlock(gc);
 }
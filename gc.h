@@ -30,6 +30,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define SIMPLE_GC_H
 
 #include <stddef.h>
+#include <stdio.h>
 
 /* opaque handle to garbage collector */
 typedef struct garbage_collector * GarbageCollector;
@@ -37,6 +38,58 @@ typedef struct garbage_collector * GarbageCollector;
 /* callback for garbage collection events */
 typedef void (*gc_event_fn)(void* object);
 
+/* callback for a batch of n objects */
+typedef void (*gc_batch_fn)(void** objects, size_t n);
+
+/* default size of a slab in bytes */
+#define GC_SLAB_SIZE (64 * 1024)
+
+/* kinds of pages backing the heap, see gc_set_backing */
+#define GC_PAGES_DEFAULT 0     /* ordinary pages */
+#define GC_PAGES_TRANSPARENT 1 /* transparent huge pages */
+#define GC_PAGES_HUGE 2        /* explicit huge pages */
+
+/* NUMA placement of the heap, see gc_set_backing; nodes are numbered
+ * from 0 */
+#define GC_NODE_LOCAL (-1)      /* node of the thread first touching a page */
+#define GC_NODE_INTERLEAVE (-2) /* page by page across all nodes */
+
+/* kinds of heap profiles, see gc_write_profile */
+#define GC_PROFILE_LIVE 0      /* bytes of sampled objects still alive */
+#define GC_PROFILE_ALLOCATED 1 /* bytes of all sampled allocations */
+
+/* number of buckets of the pause time histogram in struct gc_stats */
+#define GC_PAUSE_BUCKETS 32
+
+/* statistics of a garbage collector, see gc_stats. Times are given in
+ * nanoseconds. */
+struct gc_stats {
+     unsigned long collections;        /* collections completed */
+     unsigned long minor_collections;  /* minor collections completed */
+     unsigned long long marked;        /* objects marked by all collections */
+     unsigned long long swept;         /* allocated objects examined by sweeps */
+     unsigned long long reclaimed;     /* objects reclaimed by sweeps */
+     unsigned long long moved;         /* objects moved by gc_compact */
+     unsigned long long mark_ns;       /* time spent marking */
+     unsigned long long sweep_ns;      /* time spent sweeping */
+     unsigned long long pause_ns;      /* time the program was stopped */
+     size_t last_marked;               /* objects marked by the last collection */
+     size_t last_reclaimed;            /* objects reclaimed since the last collection */
+     unsigned long long last_mark_ns;  /* marking time of the last collection */
+     unsigned long long last_pause_ns; /* duration of the last pause */
+     unsigned long long max_pause_ns;  /* duration of the longest pause */
+     size_t heap_bytes;                /* size of the heap */
+     size_t released_bytes;            /* part of the heap given back to the system */
+     size_t live_bytes;                /* size of the objects marked by the last collection */
+     size_t huge_bytes;                /* part of the heap in explicit huge pages */
+     size_t transparent_bytes;         /* part advised to use transparent huge pages */
+     size_t bound_bytes;               /* part placed on NUMA nodes by gc_set_backing */
+     /* number of pauses by duration: pauses[0] counts pauses shorter
+        than a microsecond, pauses[i] those from 2^(i-1) up to 2^i
+        microseconds, and the last bucket all longer ones, too */
+     unsigned long pauses[GC_PAUSE_BUCKETS];
+};
+
 
 /* Create a new garbage collector.
  *
@@ -57,6 +110,28 @@ GarbageCollector gc_create(size_t nobjects,
                            gc_event_fn on_collect,
                            gc_event_fn on_destroy);
 
+/* Create a new garbage collector with a specific slab size.
+ *
+ * Objects are carved out of slabs, large page-aligned blocks of memory
+ * holding many objects each. gc_create uses slabs of GC_SLAB_SIZE
+ * bytes.
+ *
+ * Arguments:
+ * - slab_size: size of a single slab in bytes; rounded up to whole
+ *   pages and limited to 2 MiB; 0 selects GC_SLAB_SIZE. Objects that
+ *   do not fit into a slab get a slab of their own
+ * - all other arguments are the same as for gc_create
+ *
+ * Returns:
+ * A valid pointer to a garbage collector
+ */
+GarbageCollector gc_create_slab(size_t nobjects,
+                                size_t size,
+                                size_t slab_size,
+                                gc_event_fn on_mark,
+                                gc_event_fn on_collect,
+                                gc_event_fn on_destroy);
+
 /* Add new objects for the garbage collector to manage.
  *
  * Arguments:
@@ -66,6 +141,10 @@ GarbageCollector gc_create(size_t nobjects,
 void  gc_add     (GarbageCollector gc , size_t nobjects);
 
 /* Request an object from the garbage collector.
+ *
+ * If there is no free object, the garbage collector collects. After
+ * gc_set_growth it grows the heap instead, as long as the heap policy
+ * allows it.
  * 
  * Arguments:
  * - gc: a garbage collector
@@ -74,22 +153,121 @@ void  gc_add     (GarbageCollector gc , size_t nobjects);
  */
 void* gc_alloc   (GarbageCollector gc);
 
-/* Add an object to the garbage collector's root set.
+/* Request n objects from the garbage collector at once, like n calls
+ * of gc_alloc, but taking the free objects of a slab together and
+ * collecting at most once.
+ *
+ * Arguments:
+ * - gc: a garbage collector
+ * - n: number of objects
+ * - objects: array of n pointers to be filled in
+ * Returns:
+ * the number of objects stored in objects, less than n only if no
+ * more objects are available
+ */
+size_t gc_alloc_n(GarbageCollector gc, size_t n, void** objects);
+
+/* Request an object of any size from the garbage collector.
+ *
+ * Objects of up to 8 KiB are taken from built-in size classes, each
+ * with slabs of its own; larger objects get a slab each, which is
+ * unmapped once the object has been collected. All of them
+ * are marked and swept together with the objects of gc_alloc and use
+ * the same callbacks, so on_mark has to tell the kinds of objects
+ * apart by itself. Unlike gc_alloc, the heap always grows on demand,
+ * following the policy set with gc_set_growth. By default the heap
+ * grows to 1 MiB before the first collection, and afterwards to twice
+ * the size of the objects surviving the last collection.
+ *
+ * Arguments:
+ * - gc: a garbage collector
+ * - n: size of the object in bytes
+ * Returns:
+ * a pointer to a usable object of at least n bytes, or NULL if the
+ * maximum heap size is reached or the system cannot map an object of
+ * that size
+ */
+void* gc_alloc_size(GarbageCollector gc, size_t n);
+
+/* Add an object to the garbage collector's root set. An object can be
+ * added several times; it stays in the root set until each of its
+ * roots has been removed.
  *
  * Arguments:
  * - gc: a garbage collector
- * - object: the object to add; must have been created with gc_alloc
+ * - object: the object to add; must have been created with gc_alloc or
+ *   gc_alloc_size
+ * Returns:
+ * a handle for removing this root with gc_unroot_handle
  */
-void  gc_root    (GarbageCollector gc , void* object);
+size_t gc_root   (GarbageCollector gc , void* object);
 
-/* Remove an object from the garbage collector's root set.
+/* Remove an object from the garbage collector's root set. This removes
+ * every root of the object and takes time proportional to the size of
+ * the root set; gc_unroot_handle is faster.
  *
  * Arguments:
  * - gc: a garbage collector
- * - object: the object to remove; must have been created with gc_alloc
+ * - object: the object to remove; must have been created with gc_alloc or
+ *   gc_alloc_size
  */
 void  gc_unroot  (GarbageCollector gc , void* object);
 
+/* Remove a single root from the garbage collector's root set in
+ * constant time. The handle may be returned by gc_root again afterwards.
+ *
+ * Arguments:
+ * - gc: a garbage collector
+ * - handle: a handle returned by gc_root and not removed yet
+ */
+void  gc_unroot_handle(GarbageCollector gc, size_t handle);
+
+/* Create a weak reference to key. Unlike a root, it does not keep key
+ * alive: once key is collected, the reference is cleared. value, if
+ * given, is kept alive as long as key is, but does not keep key alive
+ * itself, even if it references key. Such an ephemeron associates data
+ * with an object without keeping either alive, e.g. in a cache or a
+ * table of interned symbols. Weak references are checked after each
+ * collection has marked everything reachable.
+ *
+ * Arguments:
+ * - gc: a garbage collector
+ * - key: the object to refer to weakly
+ * - value: object kept alive while key is alive; can be NULL
+ * Returns:
+ * a handle for reading the reference and for freeing it with
+ * gc_weak_free
+ */
+size_t gc_weak(GarbageCollector gc, void* key, void* value);
+
+/* Read the key of a weak reference.
+ *
+ * Arguments:
+ * - gc: a garbage collector
+ * - handle: a handle returned by gc_weak
+ * Returns:
+ * the key, or NULL if it has been collected
+ */
+void* gc_weak_key(GarbageCollector gc, size_t handle);
+
+/* Read the value of a weak reference.
+ *
+ * Arguments:
+ * - gc: a garbage collector
+ * - handle: a handle returned by gc_weak
+ * Returns:
+ * the value, or NULL if the key has been collected
+ */
+void* gc_weak_value(GarbageCollector gc, size_t handle);
+
+/* Free a weak reference. The handle may be returned by gc_weak again.
+ *
+ * Arguments:
+ * - gc: a garbage collector
+ * - handle: a handle returned by gc_weak
+ */
+void  gc_weak_free(GarbageCollector gc, size_t handle);
+
 /* Protect objects at a specific memory location from garbage collection.
  *
  * Arguments:
@@ -98,17 +276,33 @@ void  gc_unroot  (GarbageCollector gc , void* object);
  */
 void  gc_protect (GarbageCollector gc , void** object);
 
-/* Expose the most recently protected memory locations to the garbage collector.
+/* Protect n consecutive memory locations, e.g. the locals of a
+ * function gathered in an array, from garbage collection. The
+ * locations form a single frame on a shadow stack: gc_expose(gc,1)
+ * exposes all of them again. Only the address of the array is stored,
+ * so the array must stay in place until it is exposed, and the pointers
+ * in it may change in the meantime.
+ *
+ * Arguments:
+ * - gc: a garbage collector
+ * - slots: address of the first pointer to an object
+ * - n: number of pointers
+ */
+void  gc_protect_frame(GarbageCollector gc, void** slots, size_t n);
+
+/* Expose the most recently protected memory locations to the garbage
+ * collector. A frame protected with gc_protect_frame counts as a
+ * single location.
  *
  * Arguments:
  * - gc: a garbage collector
- * - n: the number of objects to expose
+ * - n: the number of gc_protect and gc_protect_frame calls to undo
  */
 void  gc_expose  (GarbageCollector gc , size_t n);
 
 /* Free all memory associated with a garbage collector. The function
  * on_destroy given when creating the the garbage collector is called
- * for each managed object with that object as an argument.
+ * for each allocated object with that object as an argument.
  *
  * Arguments:
  * - gc: address of a garbage collector
@@ -121,16 +315,429 @@ void  gc_free    (GarbageCollector* gc);
  * once. A function can be passed in to continue marking other objects
  * referenced by the current object.
  *
+ * cont is not called right away: the object is pushed onto the mark
+ * stack of its garbage collector and cont is called when the object is
+ * popped again. A cont that calls gc_mark for each referenced object
+ * therefore never recurses, no matter how deep the object graph is.
+ *
  * Arguments:
  * - cont: pointer to a function that is marking other objects; can be NULL
  * - object: the object that just has been marked
  */
 void  gc_mark    (gc_event_fn cont, void* object);
 
+/* Mark the object stored in a slot as reachable, like gc_mark. The
+ * slot must be a field of the object currently being traced, or a
+ * protected slot. During gc_compact the object may be moved, and the
+ * slot is then updated to its new address. Objects that are only
+ * marked with gc_mark never move.
+ *
+ * Arguments:
+ * - cont: pointer to a function that is marking other objects; can be NULL
+ * - slot: location of a reference to a managed object; may hold NULL
+ */
+void  gc_mark_slot(gc_event_fn cont, void** slot);
+
+/* Keep an object from being moved by gc_compact until it is unpinned
+ * or collected.
+ *
+ * Arguments:
+ * - object: a managed object
+ */
+void  gc_pin     (void* object);
+
+/* Let gc_compact move an object again.
+ *
+ * Arguments:
+ * - object: a managed object
+ */
+void  gc_unpin   (void* object);
+
+/* Collect all unreachable objects and move the survivors of sparsely
+ * used slabs into the free space of fuller slabs of the same size, so
+ * the emptied slabs can be given back to the system.
+ *
+ * Only objects found through gc_mark_slot move; references to them are
+ * updated in place, including protected slots. Objects marked with
+ * gc_mark, rooted objects, pinned objects and objects smaller than a
+ * pointer stay where they are, as do objects of gc_alloc_size larger
+ * than 8 KiB, which have a slab of their own. Marking happens on the
+ * calling thread, and any pointer to a movable object held outside the
+ * heap and the protected slots is left dangling.
+ *
+ * Arguments:
+ * - gc: a garbage collector
+ */
+void  gc_compact (GarbageCollector gc);
+
+/* Write the objects reachable from root to a heap image file, which
+ * gc_load_image maps into a collector again, e.g. to start a program
+ * with a prepared heap instead of building it object by object.
+ *
+ * References between the saved objects are found by tracing them, so
+ * they must be marked with gc_mark_slot or described by a layout, like
+ * the references of objects moved by gc_compact. Roots, protected
+ * slots and weak references are not saved. An image can only be loaded
+ * by the same build of the library, into a collector of the same object
+ * size.
+ *
+ * Arguments:
+ * - gc: a garbage collector
+ * - path: name of the file to create or overwrite
+ * - root: a managed object referencing everything to save
+ * Returns:
+ * zero on success; -1 with errno set if the file cannot be written or
+ * an object reachable from root is marked with gc_mark, in which case
+ * errno is EINVAL
+ */
+int   gc_save_image(GarbageCollector gc, const char* path, void* root);
+
+/* Add the objects of a heap image written by gc_save_image to a
+ * collector. The slabs of the image are mapped from the file, at the
+ * addresses they were saved from if those are free. Such an image needs
+ * no changes: its pages are shared with every other process loading the
+ * same image until they are written to. Otherwise the references
+ * between the objects are relocated.
+ *
+ * The loaded objects are collected like any other object, so root
+ * or protect the returned object before the next allocation.
+ *
+ * Arguments:
+ * - gc: a garbage collector
+ * - path: name of an image file
+ * Returns:
+ * the root object of the image, or NULL with errno set if the image
+ * cannot be read, mapped or is invalid for gc
+ */
+void* gc_load_image(GarbageCollector gc, const char* path);
+
 /* Collect all unreachable objects.
+ *
+ * With lazy sweeping enabled this only marks reachable objects and
+ * sweeps the slab each thread currently allocates from in every size
+ * class, and the slabs of objects larger than 8 KiB. The remaining
+ * slabs are swept by gc_alloc, one at a time, as it runs out of free
+ * objects.
  *
  * Arguments:
  * - gc: a garbage collector
  */
 void  gc_collect (GarbageCollector gc);
+
+/* Advance an incremental collection by a bounded amount of work. The
+ * first call starts a new cycle by marking the root set, every call
+ * traces at most work objects, i.e. calls on_mark at most work times.
+ * Once nothing is left to trace, the root set is marked again and the
+ * heap is swept, which ends the cycle. gc_collect completes a cycle in
+ * progress.
+ *
+ * Between two steps, the mutator must call gc_write_barrier whenever
+ * it stores a reference to a managed object into another managed
+ * object. Objects allocated during a cycle survive it.
+ *
+ * on_mark needs no changes for incremental collection as long as it
+ * only calls gc_mark for the objects it references: gc_mark pushes
+ * them onto the mark stack and returns.
+ *
+ * Arguments:
+ * - gc: a garbage collector
+ * - work: maximum number of objects to trace
+ * Returns:
+ * non-zero if the cycle is complete, zero otherwise
+ */
+int   gc_collect_step(GarbageCollector gc, size_t work);
+
+/* Record that a reference to value has been stored into object.
+ * During an incremental collection this marks value gray, so an object
+ * that has already been traced never points to an unmarked one. In
+ * generational mode an old object given a reference to a young one is
+ * added to the remembered set. Cheap when neither applies.
+ *
+ * Arguments:
+ * - object: the managed object that has been written to
+ * - value: the reference stored into object; can be NULL
+ */
+void  gc_write_barrier(void* object, void* value);
+
+/* Collect unreachable young objects only. In generational mode every
+ * object that survives a collection becomes old, and old objects are
+ * neither traced nor swept by a minor collection, so its cost depends
+ * on the number of young objects rather than the size of the heap.
+ * Young objects only referenced by old objects are found through a
+ * remembered set fed by gc_write_barrier. Without generational mode
+ * this is the same as gc_collect.
+ *
+ * Arguments:
+ * - gc: a garbage collector
+ */
+void  gc_collect_minor(GarbageCollector gc);
+
+/* Enable or disable generational mode. In generational mode gc_alloc
+ * runs a minor collection when it runs out of objects and falls back
+ * to a full collection only if that did not free anything; gc_collect
+ * always collects the whole heap.
+ *
+ * The mutator must call gc_write_barrier whenever it stores a
+ * reference to a managed object into another managed object.
+ *
+ * Arguments:
+ * - gc: a garbage collector
+ * - generational: non-zero to enable, zero to disable
+ */
+void  gc_set_generational(GarbageCollector gc, int generational);
+
+/* Allow several threads to share a garbage collector. The calling
+ * thread is attached to the collector; every other thread has to call
+ * gc_thread_attach before using it.
+ *
+ * Each thread allocates from slabs of its own without taking a lock and
+ * has its own protected memory locations; the root set is shared. A
+ * collection first waits for every other attached thread to reach a
+ * safepoint. gc_alloc is a safepoint; threads that do not allocate for
+ * a long time have to call gc_safepoint regularly or detach.
+ *
+ * Incremental collection is not available in this mode:
+ * gc_collect_step runs a complete collection.
+ *
+ * Arguments:
+ * - gc: a garbage collector
+ */
+void  gc_set_threaded(GarbageCollector gc);
+
+/* Attach the calling thread to a garbage collector shared with
+ * gc_set_threaded.
+ *
+ * Arguments:
+ * - gc: a garbage collector
+ */
+void  gc_thread_attach(GarbageCollector gc);
+
+/* Detach the calling thread from a garbage collector. The thread must
+ * not have any protected memory locations left.
+ *
+ * Arguments:
+ * - gc: a garbage collector
+ */
+void  gc_thread_detach(GarbageCollector gc);
+
+/* Stop the calling thread if another thread is waiting to collect
+ * garbage, and resume once the collection is finished.
+ *
+ * Arguments:
+ * - gc: a garbage collector
+ */
+void  gc_safepoint(GarbageCollector gc);
+
+/* Set the number of threads marking objects during a collection. With
+ * more than one, the collecting thread and n - 1 helper threads trace
+ * the heap together, each from its own stack of objects, and share
+ * part of it when others run out of work. Helper threads are started
+ * right away and sleep between collections.
+ *
+ * on_mark is called from several threads at once in this mode. It must
+ * not modify shared state other than by calling gc_mark.
+ *
+ * Arguments:
+ * - gc: a garbage collector
+ * - n: number of marking threads; 0 or 1 marks on the collecting thread
+ */
+void  gc_set_markers(GarbageCollector gc, size_t n);
+
+/* Enable or disable conservative stack scanning. While enabled, every
+ * collection scans the stacks and registers of all attached threads
+ * and keeps every allocated object a word on them points into, so
+ * objects referenced from local variables need not be protected. Roots
+ * are still needed for references stored outside the heap and the
+ * stacks, e.g. in global variables. An object found this way is never
+ * moved by gc_compact, and a stale word can keep garbage alive.
+ *
+ * Arguments:
+ * - gc: a garbage collector
+ * - conservative: non-zero to scan the stacks
+ */
+void  gc_set_conservative(GarbageCollector gc, int conservative);
+
+/* Enable or disable deferred finalization. While enabled, sweeping
+ * does not call on_collect. Dead objects are queued instead and stay
+ * allocated until they have been finalized by gc_run_finalizers, so
+ * expensive finalizers run outside of collection pauses. Queued
+ * objects are traced, so the objects they reference stay intact until
+ * they have been finalized. Finalized objects are reused after the
+ * next collection.
+ *
+ * Arguments:
+ * - gc: a garbage collector
+ * - deferred: non-zero to queue dead objects; zero finalizes all
+ *   queued objects and calls on_collect while sweeping again
+ * - per_alloc: number of queued objects gc_alloc and gc_alloc_size
+ *   finalize whenever they need a new slab; 0 to only finalize in
+ *   gc_run_finalizers
+ * - on_collect_batch: called with a batch of queued objects instead of
+ *   calling on_collect for each of them; can be NULL
+ */
+void  gc_set_deferred_finalization(GarbageCollector gc, int deferred, size_t per_alloc, gc_batch_fn on_collect_batch);
+
+/* Finalize objects queued by deferred finalization, by calling
+ * on_collect_batch, or on_collect for each object.
+ *
+ * Arguments:
+ * - gc: a garbage collector
+ * - max: maximum number of objects to finalize
+ * Returns:
+ * the number of objects finalized
+ */
+size_t gc_run_finalizers(GarbageCollector gc, size_t max);
+
+/* Enable or disable the sampling heap profiler. While enabled, about
+ * one allocation per sample_bytes allocated bytes is sampled: its
+ * stack is recorded and it is followed until a collection finds it
+ * dead. Each sample stands for the bytes allocated since the previous
+ * one, so small objects are sampled rarely and the profile estimates
+ * the bytes allocated by each stack. While disabled, allocation only
+ * pays for checking whether profiling is enabled.
+ *
+ * Arguments:
+ * - gc: a garbage collector
+ * - sample_bytes: average number of bytes allocated between two
+ *   samples, e.g. 512 KiB; 0 disables profiling and discards the
+ *   profile
+ */
+void  gc_set_profiling(GarbageCollector gc, size_t sample_bytes);
+
+/* Write the profile of gc_set_profiling in the folded stack format of
+ * flame graph tools: a line per allocating stack, with its frames from
+ * the outermost to gc_alloc's caller separated by semicolons, a space
+ * and the estimated bytes. Frames are named by their function if it is
+ * exported, e.g. linked with -rdynamic, and by their offset in the
+ * binary otherwise.
+ *
+ * Arguments:
+ * - gc: a garbage collector
+ * - out: file to write to
+ * - kind: GC_PROFILE_LIVE for the objects that survived the last
+ *   collection or were allocated since, GC_PROFILE_ALLOCATED for all
+ *   allocations since profiling was enabled
+ * Returns:
+ * zero on success, -1 if writing failed
+ */
+int   gc_write_profile(GarbageCollector gc, FILE* out, int kind);
+
+/* Describe where objects of gc_alloc keep their references, so the
+ * collector traces them itself instead of calling on_mark. Each offset
+ * locates a field holding a managed object or NULL; the fields are
+ * marked as if by gc_mark_slot with on_mark as cont, so objects of
+ * gc_alloc_size they reference are still traced by on_mark, which no
+ * longer sees objects of gc_alloc. The offsets are copied.
+ *
+ * Arguments:
+ * - gc: a garbage collector
+ * - offsets: offsets in bytes of the reference fields, e.g. from
+ *   offsetof; NULL to trace objects of gc_alloc by on_mark again
+ * - n: number of offsets; 0 for objects without references
+ */
+void  gc_set_layout(GarbageCollector gc, const size_t* offsets, size_t n);
+
+/* Enable or disable lazy sweeping. Disabling it finishes any sweep
+ * still pending.
+ *
+ * Arguments:
+ * - gc: a garbage collector
+ * - lazy: non-zero to sweep lazily, zero to sweep in gc_collect
+ */
+void  gc_set_lazy_sweep(GarbageCollector gc, int lazy);
+
+/* Set the policy by which the heap grows, and let gc_alloc grow the
+ * heap instead of returning NULL when it runs out of objects.
+ *
+ * After each collection, the heap may grow until the surviving objects
+ * fill a fraction occupancy of it before the next collection is
+ * triggered. A low survival rate therefore keeps the heap small, while
+ * a high one grows it geometrically, and the number of collections
+ * stays proportional to the amount of memory allocated. Free room in
+ * the slabs of other sizes does not hold back a size that ran out: it
+ * grows while the surviving objects and those allocated since the
+ * collection are below the threshold. The heap always grows to
+ * min_heap bytes before collecting and never beyond max_heap bytes; if
+ * a collection reclaims nothing, the heap grows beyond the threshold
+ * up to that limit.
+ *
+ * Arguments:
+ * - gc: a garbage collector
+ * - occupancy: target fraction of the heap live after a collection,
+ *   greater than 0 and less than 1
+ * - min_heap: heap size in bytes up to which the heap grows without
+ *   collecting
+ * - max_heap: limit of the heap size in bytes, 0 for no limit
+ */
+void  gc_set_growth(GarbageCollector gc, double occupancy, size_t min_heap, size_t max_heap);
+
+/* Set the memory backing slabs mapped from now on, e.g. before
+ * growing a large heap with gc_add. Huge pages let marking and
+ * sweeping a large heap get by with far fewer TLB entries; while they
+ * are selected, slabs grow to 2 MiB each so that a huge page backs a
+ * whole slab. Explicit huge pages have to be reserved by the system
+ * administrator, otherwise transparent huge pages are used instead.
+ * Slabs can be bound to a NUMA node, or interleaved across all nodes,
+ * instead of being placed on the node of the thread first touching
+ * them.
+ *
+ * Requests that cannot be met fall back to ordinary placement and
+ * pages; huge_bytes, transparent_bytes and bound_bytes of gc_stats
+ * report the backing actually obtained.
+ *
+ * Arguments:
+ * - gc: a garbage collector
+ * - pages: GC_PAGES_DEFAULT, GC_PAGES_TRANSPARENT or GC_PAGES_HUGE
+ * - node: a NUMA node, GC_NODE_LOCAL or GC_NODE_INTERLEAVE
+ */
+void  gc_set_backing(GarbageCollector gc, int pages, int node);
+
+/* Set when memory of the heap is given back to the system. A slab
+ * that a sweep finds without objects cycles times in a row keeps its
+ * address range but has its memory released, as long as at least
+ * retain bytes of the heap stay in memory. Waiting for a few
+ * collections keeps memory that is about to be used again from going
+ * back and forth. A released slab gets fresh memory from the system
+ * when it is used again. Released memory does not count toward the
+ * heap size gc_set_growth limits, so another size class can grow into
+ * it. By default, slabs are released after 2 collections, retaining
+ * 1 MiB.
+ *
+ * Arguments:
+ * - gc: a garbage collector
+ * - retain: heap size in bytes that always stays in memory
+ * - cycles: number of collections a slab has to stay empty before its
+ *   memory is released; 0 never releases memory
+ */
+void  gc_set_release(GarbageCollector gc, size_t retain, unsigned cycles);
+
+/* Enable or disable background sweeping. While enabled, a collection
+ * returns as soon as marking is done and a separate thread sweeps the
+ * heap, one slab at a time. gc_alloc takes objects from every slab the
+ * thread has finished and only sweeps a slab itself when it has caught
+ * up with the thread. Disabling it finishes any sweep still pending
+ * and stops the thread.
+ *
+ * on_collect is called from the sweeping thread in this mode, except
+ * for objects of gc_alloc_size larger than 8 KiB, which the collection
+ * sweeps itself to unmap their slabs.
+ *
+ * Arguments:
+ * - gc: a garbage collector
+ * - background: non-zero to sweep in a background thread
+ */
+void  gc_set_background_sweep(GarbageCollector gc, int background);
+
+/* Report statistics of a garbage collector. The counters are always
+ * kept up to date: they cost two clock readings per collection step and
+ * per slab swept, and a count of the mark bits after marking.
+ *
+ * Sweeping happens lazily or in the background when enabled, so
+ * reclaimed objects of the last collection may still be coming in.
+ *
+ * Arguments:
+ * - gc: a garbage collector
+ * - stats: structure to fill in
+ */
+void  gc_stats(GarbageCollector gc, struct gc_stats* stats);
 #endif
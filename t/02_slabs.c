@@ -0,0 +1,100 @@
+#include "../gc.h"
+#include "../test.h"
+
+#include <stdio.h>
+
+static int destroyed;
+static void count_destroy(void* object) {
+     (void)object;
+     destroyed++;
+}
+
+/* number of mappings of this process, or -1 if unknown */
+static int mappings(void) {
+     FILE* maps = fopen("/proc/self/maps","r");
+     int n = 0, c;
+     if (!maps)
+          return -1;
+     while ((c = fgetc(maps)) != EOF)
+          n += c == '\n';
+     fclose(maps);
+     return n;
+}
+
+/* kilobytes of address space of this process, or -1 if unknown */
+static long address_space(void) {
+     FILE* status = fopen("/proc/self/status","r");
+     char line[256];
+     long kb = -1;
+     if (!status)
+          return -1;
+     while (fgets(line,sizeof line,status))
+          if (sscanf(line,"VmSize: %ld",&kb) == 1)
+               break;
+     fclose(status);
+     return kb;
+}
+
+/* whether writable memory is charged when it is mapped */
+static int strict_overcommit(void) {
+     FILE* f = fopen("/proc/sys/vm/overcommit_memory","r");
+     int mode = 0;
+     if (f) {
+          if (fscanf(f,"%d",&mode) != 1)
+               mode = 0;
+          fclose(f);
+     }
+     return mode == 2;
+}
+
+int main(int argc, char** argv) {
+     GarbageCollector gc = gc_create_slab(1000,sizeof(int),4096,NULL,NULL,count_destroy);
+     int* objects[1000];
+     int i, ascending = 0, distinct = 1;
+
+     for (i = 0; i < 1000; i++) {
+          objects[i] = gc_alloc(gc);
+          gc_root(gc,objects[i]);
+          *objects[i] = i;
+     }
+     ok(objects[999],"allocating objects across several slabs");
+     ok(gc_alloc(gc) == NULL,"managing exactly the requested number of objects");
+
+     for (i = 1; i < 1000; i++) {
+          if (objects[i] == objects[i-1])
+               distinct = 0;
+          if (objects[i] > objects[i-1])
+               ascending++;
+     }
+     ok(distinct,"handing out distinct objects");
+     ok(ascending > 990,"handing out objects in address order within a slab");
+
+     for (i = 0; i < 1000; i++)
+          if (*objects[i] != i)
+               break;
+     ok(i == 1000,"objects do not overlap");
+
+     gc_add(gc,1);
+     ok(gc_alloc(gc) != NULL,"adding a single object to a partially used slab");
+
+     gc_free(&gc);
+     ok(destroyed == 1001,"destroying every allocated object");
+
+     /* 1000 slabs of one object each share a few mappings */
+     int before = mappings();
+     gc = gc_create_slab(1000,4096,4096,NULL,NULL,NULL);
+     int after = mappings();
+     ok(before < 0 || strict_overcommit() || after - before < 100,"mapping slabs together");
+     gc_free(&gc);
+
+     /* a small collector reserves about as much as its slab */
+     long size = address_space();
+     gc = gc_create(1,16,NULL,NULL,NULL);
+     ok(gc_alloc(gc) != NULL && (size < 0 || address_space() - size < 8 * 1024),
+        "reserving little address space for a small heap");
+     gc_free(&gc);
+
+     finish();
+
+     return 0;
+}
@@ -0,0 +1,49 @@
+#include "../gc.h"
+#include "../test.h"
+
+static int collected;
+static void count_collect(void* object) {
+     (void)object;
+     collected++;
+}
+
+int main(int argc, char** argv) {
+     GarbageCollector gc = gc_create(200,sizeof(int),NULL,count_collect,NULL);
+     int* objects[200];
+     int i;
+
+     for (i = 0; i < 200; i++)
+          objects[i] = gc_alloc(gc);
+     ok((char*)objects[1] - (char*)objects[0] == sizeof(int),
+        "packing objects without a header");
+
+     for (i = 0; i < 200; i += 2)
+          gc_root(gc,objects[i]);
+     gc_collect(gc);
+     ok(collected == 100,"collecting every unmarked object");
+
+     collected = 0;
+     gc_collect(gc);
+     ok(collected == 0,"clearing marks without collecting live objects");
+
+     for (i = 0; i < 100; i++)
+          if (gc_alloc(gc) != objects[2*i + 1])
+               break;
+     ok(i == 100,"reusing collected objects in address order");
+
+     gc_free(&gc);
+
+     gc = gc_create(2,100000,NULL,NULL,NULL);
+     char* big = gc_alloc(gc);
+     char* other = gc_alloc(gc);
+     ok(big && other,"allocating objects larger than a slab");
+     big[99999] = 1;
+     gc_root(gc,other);
+     gc_collect(gc);
+     ok(gc_alloc(gc) == big,"collecting objects larger than a slab");
+     gc_free(&gc);
+
+     finish();
+
+     return 0;
+}
@@ -0,0 +1,49 @@
+#include "../gc.h"
+#include "../test.h"
+
+#define LENGTH 1000000
+
+typedef struct cell * Cell;
+struct cell {
+     Cell next;
+};
+
+static void cell_mark(void* object) {
+     gc_mark(cell_mark,((Cell)object)->next);
+}
+
+static int collected;
+static void count_collect(void* object) {
+     (void)object;
+     collected++;
+}
+
+int main(int argc, char** argv) {
+     GarbageCollector gc = gc_create(LENGTH + 1,sizeof(struct cell),cell_mark,count_collect,NULL);
+     Cell head = NULL;
+     int i;
+
+     gc_protect(gc,(void**)&head);
+     for (i = 0; i < LENGTH; i++) {
+          Cell c = gc_alloc(gc);
+          c->next = head;
+          head = c;
+     }
+     Cell garbage = gc_alloc(gc);
+     garbage->next = head;
+
+     gc_collect(gc);
+     ok(collected == 1,"tracing a long list without recursing");
+
+     head = head->next;
+     collected = 0;
+     gc_collect(gc);
+     ok(collected == 1,"collecting the unreachable list head");
+
+     gc_expose(gc,1);
+     gc_free(&gc);
+
+     finish();
+
+     return 0;
+}
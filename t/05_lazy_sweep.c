@@ -0,0 +1,42 @@
+#include "../gc.h"
+#include "../test.h"
+
+static int collected;
+static void count_collect(void* object) {
+     (void)object;
+     collected++;
+}
+
+int main(int argc, char** argv) {
+     GarbageCollector gc = gc_create_slab(10000,sizeof(void*),4096,NULL,count_collect,NULL);
+     void* first = NULL;
+     int i;
+
+     gc_set_lazy_sweep(gc,1);
+     for (i = 0; i < 10000; i++) {
+          void* object = gc_alloc(gc);
+          if (i == 0)
+               first = object;
+     }
+     gc_root(gc,first);
+
+     gc_collect(gc);
+     ok(collected > 0 && collected < 1000,"sweeping only the first slab in gc_collect");
+
+     for (i = 0; i < 9999; i++)
+          if (!gc_alloc(gc))
+               break;
+     ok(i == 9999,"sweeping the remaining slabs in gc_alloc");
+     ok(collected == 9999,"collecting every dead object exactly once");
+
+     collected = 0;
+     gc_collect(gc);
+     gc_set_lazy_sweep(gc,0);
+     ok(collected == 9999,"finishing a pending sweep when disabling lazy sweeping");
+
+     gc_free(&gc);
+
+     finish();
+
+     return 0;
+}
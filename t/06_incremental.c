@@ -0,0 +1,60 @@
+#include "../gc.h"
+#include "../test.h"
+
+typedef struct cell * Cell;
+struct cell {
+     Cell next;
+};
+
+static void cell_mark(void* object) {
+     gc_mark(cell_mark,((Cell)object)->next);
+}
+
+static int collected;
+static void count_collect(void* object) {
+     (void)object;
+     collected++;
+}
+
+int main(int argc, char** argv) {
+     GarbageCollector gc = gc_create(10,sizeof(struct cell),cell_mark,count_collect,NULL);
+
+     Cell a = gc_alloc(gc);
+     Cell b = gc_alloc(gc);
+     Cell w = gc_alloc(gc);
+     Cell garbage = gc_alloc(gc);
+     a->next = b;
+     b->next = w;
+     w->next = NULL;
+     garbage->next = a;
+     gc_root(gc,a);
+
+     ok(gc_collect_step(gc,1) == 0,"tracing a bounded number of objects");
+
+     /* a is black, b is gray: move w from b to a */
+     a->next = w;
+     gc_write_barrier(a,w);
+     b->next = NULL;
+
+     Cell fresh = gc_alloc(gc);
+     fresh->next = NULL;
+     b->next = fresh;
+     gc_write_barrier(b,fresh);
+
+     while (!gc_collect_step(gc,1))
+          ;
+     ok(collected == 1,"keeping objects stored behind the barrier");
+
+     collected = 0;
+     a->next = b;
+     b->next = NULL;
+     ok(gc_collect_step(gc,1) == 0,"starting another cycle");
+     gc_collect(gc);
+     ok(collected == 2,"completing a cycle in gc_collect");
+
+     gc_free(&gc);
+
+     finish();
+
+     return 0;
+}
@@ -0,0 +1,62 @@
+#include "../gc.h"
+#include "../test.h"
+
+typedef struct cell * Cell;
+struct cell {
+     Cell next;
+};
+
+static int traced;
+static void cell_mark(void* object) {
+     traced++;
+     gc_mark(cell_mark,((Cell)object)->next);
+}
+
+static int collected;
+static void count_collect(void* object) {
+     (void)object;
+     collected++;
+}
+
+int main(int argc, char** argv) {
+     GarbageCollector gc = gc_create(100,sizeof(struct cell),cell_mark,count_collect,NULL);
+     gc_set_generational(gc,1);
+
+     Cell old = gc_alloc(gc);
+     old->next = gc_alloc(gc);
+     old->next->next = NULL;
+     gc_root(gc,old);
+     gc_collect_minor(gc);
+     ok(collected == 0,"promoting survivors of a minor collection");
+
+     Cell young = gc_alloc(gc);
+     young->next = NULL;
+     old->next->next = young;
+     gc_write_barrier(old->next,young);
+     gc_alloc(gc); /* garbage */
+
+     traced = 0;
+     gc_collect_minor(gc);
+     ok(collected == 1,"collecting young garbage");
+     ok(traced == 2,"tracing only remembered and young objects");
+
+     collected = 0;
+     gc_collect_minor(gc);
+     ok(collected == 0,"keeping young objects referenced by old ones");
+
+     struct gc_stats stats;
+     gc_stats(gc,&stats);
+     ok(stats.live_bytes == 3 * sizeof(struct cell),"counting old survivors of a minor collection");
+
+     gc_unroot(gc,old);
+     gc_collect_minor(gc);
+     ok(collected == 0,"leaving old objects to full collections");
+     gc_collect(gc);
+     ok(collected == 3,"collecting old objects in a full collection");
+
+     gc_free(&gc);
+
+     finish();
+
+     return 0;
+}
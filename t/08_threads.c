@@ -0,0 +1,83 @@
+#include "../gc.h"
+#include "../test.h"
+
+#include <pthread.h>
+
+#define NTHREADS 8
+#define LENGTH 100
+#define ROUNDS 20000
+
+typedef struct cell * Cell;
+struct cell {
+     Cell next;
+     long value;
+};
+
+static void cell_mark(void* object) {
+     gc_mark(cell_mark,((Cell)object)->next);
+}
+
+static GarbageCollector gc;
+static int intact[NTHREADS];
+
+static void* worker(void* arg) {
+     long id = (long)arg;
+     Cell head = NULL;
+     long i;
+
+     gc_thread_attach(gc);
+     gc_protect(gc,(void**)&head);
+
+     for (i = 0; i < ROUNDS; i++) {
+          Cell c = gc_alloc(gc);
+          if (!c)
+               break;
+          c->value = id;
+          c->next = head;
+          head = c;
+          if (i % LENGTH == 0) /* drop the list, leaving garbage behind */
+               head->next = NULL;
+     }
+
+     Cell cur;
+     long n = 0;
+     intact[id] = i == ROUNDS;
+     for (cur = head; cur; cur = cur->next, n++)
+          if (cur->value != id)
+               intact[id] = 0;
+     if (n != (ROUNDS - 1) % LENGTH + 1)
+          intact[id] = 0;
+
+     gc_expose(gc,1);
+     gc_thread_detach(gc);
+     return NULL;
+}
+
+int main(int argc, char** argv) {
+     pthread_t threads[NTHREADS];
+     long i;
+
+     gc = gc_create_slab(NTHREADS * 4 * LENGTH,sizeof(struct cell),4096,cell_mark,NULL,NULL);
+     gc_set_threaded(gc);
+     gc_thread_detach(gc); /* not allocating while waiting for the workers */
+
+     for (i = 0; i < NTHREADS; i++)
+          pthread_create(&threads[i],NULL,worker,(void*)i);
+     for (i = 0; i < NTHREADS; i++)
+          pthread_join(threads[i],NULL);
+
+     for (i = 0; i < NTHREADS; i++)
+          if (!intact[i])
+               break;
+     ok(i == NTHREADS,"allocating and collecting from several threads");
+
+     gc_thread_attach(gc);
+     Cell c = gc_alloc(gc);
+     ok(c != NULL,"allocating from the creating thread");
+
+     gc_free(&gc);
+
+     finish();
+
+     return 0;
+}
@@ -0,0 +1,61 @@
+#include "../gc.h"
+#include "../test.h"
+
+#define DEPTH 16
+
+typedef struct tree * Tree;
+struct tree {
+     Tree left;
+     Tree right;
+};
+
+static long traced;
+static void tree_mark(void* object) {
+     Tree t = object;
+     __atomic_add_fetch(&traced,1,__ATOMIC_RELAXED);
+     gc_mark(tree_mark,t->left);
+     gc_mark(tree_mark,t->right);
+}
+
+static long collected;
+static void count_collect(void* object) {
+     (void)object;
+     collected++;
+}
+
+static Tree tree(GarbageCollector gc, int depth) {
+     Tree t = gc_alloc(gc);
+     t->left = depth > 0 ? tree(gc,depth - 1) : NULL;
+     t->right = depth > 0 ? tree(gc,depth - 1) : NULL;
+     return t;
+}
+
+int main(int argc, char** argv) {
+     long nodes = (1L << (DEPTH + 1)) - 1;
+     GarbageCollector gc = gc_create(3 * nodes,sizeof(struct tree),tree_mark,count_collect,NULL);
+     gc_set_markers(gc,4);
+
+     Tree live = tree(gc,DEPTH);
+     tree(gc,DEPTH); /* garbage */
+     gc_root(gc,live);
+
+     gc_collect(gc);
+     ok(traced == nodes,"tracing every reachable object exactly once");
+     ok(collected == nodes,"collecting every unreachable object");
+
+     traced = collected = 0;
+     gc_collect(gc);
+     ok(traced == nodes && collected == 0,"reusing marking threads");
+
+     gc_set_markers(gc,1);
+     traced = 0;
+     gc_collect(gc);
+     ok(traced == nodes,"going back to serial marking");
+
+     gc_set_markers(gc,3);
+     gc_free(&gc);
+
+     finish();
+
+     return 0;
+}
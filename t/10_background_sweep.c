@@ -0,0 +1,59 @@
+#include "../gc.h"
+#include "../test.h"
+
+#include <pthread.h>
+#include <sched.h>
+
+static pthread_t main_thread;
+static int collected;
+static int off_thread;
+static void count_collect(void* object) {
+     (void)object;
+     __atomic_add_fetch(&collected,1,__ATOMIC_RELAXED);
+     if (!pthread_equal(pthread_self(),main_thread))
+          __atomic_add_fetch(&off_thread,1,__ATOMIC_RELAXED);
+}
+
+int main(int argc, char** argv) {
+     GarbageCollector gc = gc_create_slab(10000,sizeof(void*),4096,NULL,count_collect,NULL);
+     void* first = NULL;
+     int i;
+
+     main_thread = pthread_self();
+     gc_set_background_sweep(gc,1);
+     for (i = 0; i < 10000; i++) {
+          void* object = gc_alloc(gc);
+          if (i == 0)
+               first = object;
+     }
+     gc_root(gc,first);
+
+     gc_collect(gc);
+     for (i = 0; i < 9999; i++)
+          if (!gc_alloc(gc))
+               break;
+     ok(i == 9999,"allocating from slabs swept in the background");
+     ok(__atomic_load_n(&collected,__ATOMIC_RELAXED) == 9999,"collecting every dead object exactly once");
+
+     /* leave the whole sweep to the sweeping thread */
+     __atomic_store_n(&collected,0,__ATOMIC_RELAXED);
+     __atomic_store_n(&off_thread,0,__ATOMIC_RELAXED);
+     gc_collect(gc);
+     for (i = 0; i < 10000000 && __atomic_load_n(&collected,__ATOMIC_RELAXED) < 9999; i++)
+          sched_yield();
+     ok(__atomic_load_n(&collected,__ATOMIC_RELAXED) == 9999 && __atomic_load_n(&off_thread,__ATOMIC_RELAXED) > 0,
+        "calling on_collect from the sweeping thread");
+
+     for (i = 0; i < 9999; i++)
+          gc_alloc(gc);
+     __atomic_store_n(&collected,0,__ATOMIC_RELAXED);
+     gc_collect(gc);
+     gc_set_background_sweep(gc,0);
+     ok(collected == 9999,"finishing a pending sweep when disabling background sweeping");
+
+     gc_free(&gc);
+
+     finish();
+
+     return 0;
+}
@@ -0,0 +1,94 @@
+#include "../gc.h"
+#include "../test.h"
+
+#include <string.h>
+
+/* objects of any size referring to one other object */
+struct node {
+     struct node* next;
+     size_t size;
+};
+
+static void mark_node(void* object) {
+     gc_mark(mark_node,((struct node*)object)->next);
+}
+
+static int collected;
+static void count_collect(void* object) {
+     (void)object;
+     collected++;
+}
+
+static struct node* node(GarbageCollector gc, size_t size, struct node* next) {
+     struct node* n = gc_alloc_size(gc,size);
+     memset(n,(int)(size & 0xff),size);
+     n->next = next;
+     n->size = size;
+     return n;
+}
+
+/* check that the payload of a node has not been overwritten */
+static int intact(struct node* n) {
+     size_t i;
+     for (i = sizeof *n; i < n->size; i++)
+          if (((unsigned char*)n)[i] != (n->size & 0xff))
+               return 0;
+     return 1;
+}
+
+int main(int argc, char** argv) {
+     GarbageCollector gc = gc_create(0,0,mark_node,count_collect,NULL);
+     struct node* list = NULL;
+     struct node* n;
+     size_t size;
+     int good = 1, length = 0;
+
+     /* a list of nodes of every size from 16 bytes to 20 KiB, with
+        garbage of every size in between */
+     gc_protect(gc,(void**)&list);
+     for (size = 16; size <= 20000; size += 16) {
+          list = node(gc,size,list);
+          node(gc,size + 8,NULL);
+     }
+     for (n = list; n; n = n->next, length++)
+          good = good && intact(n);
+     ok(length == 1250 && good,"allocating objects of many sizes in one collector");
+
+     gc_collect(gc);
+     ok(collected == 1250,"collecting every dead object of any size");
+
+     good = 1;
+     for (n = list; n; n = n->next)
+          good = good && intact(n);
+     ok(good,"keeping reachable objects of all sizes");
+
+     struct gc_stats before, after;
+     gc_stats(gc,&before);
+     gc_alloc_size(gc,100000);
+     gc_collect(gc);
+     gc_stats(gc,&after);
+     ok(after.heap_bytes == before.heap_bytes,"unmapping the slab of a dead large object");
+
+     ok(gc_alloc(gc) == NULL,"keeping the objects of gc_alloc apart");
+
+     ok(gc_alloc_size(gc,(size_t)-100) == NULL,"rejecting sizes overflowing a slab");
+     ok(gc_alloc_size(gc,(size_t)-1 / 2) == NULL,"failing on sizes the system cannot map");
+
+     /* large objects of many sizes, none of them live, fit into a
+        small heap */
+     size_t limit = after.heap_bytes + 4 * 1024 * 1024;
+     gc_set_growth(gc,0.5,0,limit);
+     for (size = 0; size < 1000; size++)
+          if (!gc_alloc_size(gc,10000 + size * 1000))
+               break;
+     gc_stats(gc,&after);
+     ok(size == 1000 && after.heap_bytes <= limit,
+        "reusing the memory of large objects of other sizes");
+
+     gc_expose(gc,1);
+     gc_free(&gc);
+
+     finish();
+
+     return 0;
+}
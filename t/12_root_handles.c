@@ -0,0 +1,53 @@
+#include "../gc.h"
+#include "../test.h"
+
+#define NROOTS 10000
+
+static int collected;
+static void count_collect(void* object) {
+     (void)object;
+     collected++;
+}
+
+int main(int argc, char** argv) {
+     GarbageCollector gc = gc_create(NROOTS,sizeof(int),NULL,count_collect,NULL);
+     static size_t handles[NROOTS];
+     size_t i;
+
+     void* object = gc_alloc(gc);
+     size_t first = gc_root(gc,object);
+     size_t second = gc_root(gc,object);
+     ok(first != second,"handing out a handle per root");
+
+     gc_unroot_handle(gc,first);
+     gc_collect(gc);
+     ok(collected == 0,"keeping an object while it has roots left");
+
+     gc_unroot_handle(gc,second);
+     gc_collect(gc);
+     ok(collected == 1,"collecting an object once its last root is removed");
+
+     collected = 0;
+     for (i = 0; i < NROOTS; i++)
+          handles[i] = gc_root(gc,gc_alloc(gc));
+     for (i = 0; i < NROOTS; i += 2) /* remove every other root */
+          gc_unroot_handle(gc,handles[i]);
+     gc_collect(gc);
+     ok(collected == NROOTS / 2,"removing roots by handle in any order");
+
+     object = gc_alloc(gc);
+     size_t reused = gc_root(gc,object);
+     ok(reused < NROOTS,"reusing handles of removed roots");
+     gc_unroot(gc,object);
+     for (i = 1; i < NROOTS; i += 2)
+          gc_unroot_handle(gc,handles[i]);
+     collected = 0;
+     gc_collect(gc);
+     ok(collected == NROOTS / 2 + 1,"removing roots by object and by handle");
+
+     gc_free(&gc);
+
+     finish();
+
+     return 0;
+}
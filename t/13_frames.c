@@ -0,0 +1,69 @@
+#include "../gc.h"
+#include "../test.h"
+
+typedef struct pair * Pair;
+struct pair {
+     Pair car;
+     Pair cdr;
+};
+
+static void mark_pair(void* object) {
+     gc_mark(mark_pair,((Pair)object)->car);
+     gc_mark(mark_pair,((Pair)object)->cdr);
+}
+
+static int collected;
+static void count_collect(void* object) {
+     (void)object;
+     collected++;
+}
+
+/* builds a pair of two fresh pairs, protecting its locals in a frame */
+static Pair make(GarbageCollector gc, int depth) {
+     Pair locals[3] = { NULL, NULL, NULL };
+     gc_protect_frame(gc,(void**)locals,3);
+
+     if (depth > 0) {
+          locals[0] = make(gc,depth - 1);
+          locals[1] = make(gc,depth - 1);
+     }
+     gc_collect(gc); /* the locals must survive collections at any depth */
+     locals[2] = gc_alloc(gc);
+     if (locals[2]) {
+          locals[2]->car = locals[0];
+          locals[2]->cdr = locals[1];
+     }
+
+     gc_expose(gc,1);
+     return locals[2];
+}
+
+static int count(Pair p) {
+     return p ? 1 + count(p->car) + count(p->cdr) : 0;
+}
+
+int main(int argc, char** argv) {
+     GarbageCollector gc = gc_create(63,sizeof(struct pair),mark_pair,count_collect,NULL);
+
+     Pair tree = make(gc,5);
+     ok(count(tree) == 63,"keeping objects in protected frames");
+     ok(collected == 0,"collecting nothing while everything is protected");
+
+     Pair a = NULL, b = NULL;
+     gc_protect(gc,(void**)&a);
+     gc_protect_frame(gc,(void**)&tree,1);
+     gc_protect(gc,(void**)&b);
+     gc_expose(gc,1);
+     gc_collect(gc);
+     ok(collected == 0,"exposing only the most recent location");
+
+     gc_expose(gc,2); /* the frame counts as one location */
+     gc_collect(gc);
+     ok(collected == 63,"collecting objects once their frame is exposed");
+
+     gc_free(&gc);
+
+     finish();
+
+     return 0;
+}
@@ -0,0 +1,84 @@
+#include "../gc.h"
+#include "../test.h"
+
+typedef struct cell * Cell;
+struct cell {
+     Cell next;
+     long value;
+};
+
+static Cell sentinel;
+static int collections;
+static void mark_cell(void* object) {
+     if (object == sentinel) /* marked once per collection */
+          collections++;
+     gc_mark(mark_cell,((Cell)object)->next);
+}
+
+/* allocate a list of n cells, returning the number of cells allocated */
+static long fill(GarbageCollector gc, Cell* list, long n) {
+     long i;
+     for (i = 0; i < n; i++) {
+          Cell c = gc_alloc(gc);
+          if (!c)
+               break;
+          c->next = *list;
+          *list = c;
+     }
+     return i;
+}
+
+int main(int argc, char** argv) {
+     GarbageCollector gc = gc_create(0,sizeof(struct cell),mark_cell,NULL,NULL);
+     Cell list = NULL;
+     long i;
+
+     gc_set_growth(gc,0.5,0,0);
+     sentinel = gc_alloc(gc);
+     ok(sentinel != NULL,"growing an empty heap");
+     sentinel->next = NULL;
+     gc_root(gc,sentinel);
+
+     gc_protect(gc,(void**)&list);
+     ok(fill(gc,&list,200000) == 200000,"growing the heap while everything survives");
+     ok(collections > 0 && collections < 20,"growing the heap geometrically");
+
+     /* garbage only: the heap stays as it is */
+     collections = 0;
+     list = NULL;
+     for (i = 0; i < 100; i++) {
+          Cell garbage = NULL;
+          fill(gc,&garbage,100000);
+     }
+     ok(collections > 0 && collections < 100,"collecting at a bounded rate when nothing survives");
+     gc_expose(gc,1);
+     gc_free(&gc);
+
+     gc = gc_create(0,sizeof(struct cell),mark_cell,NULL,NULL);
+     gc_set_growth(gc,0.5,0,256 * 1024);
+     list = NULL;
+     gc_protect(gc,(void**)&list);
+     i = fill(gc,&list,1000000);
+     ok(i > 0 && i <= 256 * 1024 / (long)sizeof(struct cell),"failing at the maximum heap size");
+     gc_expose(gc,1);
+     gc_free(&gc);
+
+     /* strings of many sizes: every size class holds slabs of its own */
+     static void* window[4096];
+     struct gc_stats stats;
+     unsigned long seed = 1;
+     gc = gc_create(0,0,NULL,NULL,NULL);
+     gc_protect_frame(gc,window,4096);
+     for (i = 0; i < 400000; i++) {
+          seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+          window[(seed >> 20) % 4096] = gc_alloc_size(gc,8 + (seed >> 40) % 200);
+     }
+     gc_stats(gc,&stats);
+     ok(stats.collections < 200,"collecting at a bounded rate with objects of mixed sizes");
+     gc_expose(gc,1);
+     gc_free(&gc);
+
+     finish();
+
+     return 0;
+}
@@ -0,0 +1,40 @@
+#include "../gc.h"
+#include "../test.h"
+
+int main(int argc, char** argv) {
+     GarbageCollector gc = gc_create(1000,sizeof(void*),NULL,NULL,NULL);
+     struct gc_stats stats;
+     unsigned long pauses = 0;
+     int i;
+
+     for (i = 0; i < 1000; i++) {
+          void* object = gc_alloc(gc);
+          if (i % 100 == 0)
+               gc_root(gc,object);
+     }
+     gc_stats(gc,&stats);
+     ok(stats.collections == 0 && stats.reclaimed == 0,"starting without collections");
+
+     gc_collect(gc);
+     gc_stats(gc,&stats);
+     ok(stats.collections == 1,"counting collections");
+     ok(stats.last_marked == 10 && stats.marked == 10,"counting marked objects");
+     ok(stats.swept == 1000 && stats.reclaimed == 990 && stats.last_reclaimed == 990,
+        "counting swept and reclaimed objects");
+     ok(stats.live_bytes == 10 * sizeof(void*) && stats.heap_bytes >= 1000 * sizeof(void*),
+        "reporting the size of the heap and the live objects");
+
+     while (gc_collect_step(gc,1) == 0)
+          ;
+     gc_stats(gc,&stats);
+     for (i = 0; i < GC_PAUSE_BUCKETS; i++)
+          pauses += stats.pauses[i];
+     ok(stats.collections == 2 && pauses == 2,"counting pauses of full and incremental collections");
+     ok(stats.pause_ns >= stats.mark_ns && stats.pause_ns > 0,"measuring pause times");
+
+     gc_free(&gc);
+
+     finish();
+
+     return 0;
+}
@@ -0,0 +1,96 @@
+#include "../gc.h"
+#include "../test.h"
+
+typedef struct cell * Cell;
+struct cell {
+     Cell next;
+     long value;
+};
+
+static void mark_cell(void* object) {
+     gc_mark(mark_cell,((Cell)object)->next);
+}
+
+/* collections needed to build a list of objects of another size */
+static unsigned long grow_list(GarbageCollector gc) {
+     struct gc_stats stats;
+     Cell list = NULL;
+     long i;
+
+     gc_stats(gc,&stats);
+     unsigned long collections = stats.collections;
+     gc_protect(gc,(void**)&list);
+     for (i = 0; i < 500000; i++) {
+          Cell c = gc_alloc_size(gc,40);
+          c->next = list;
+          list = c;
+     }
+     gc_expose(gc,1);
+     gc_stats(gc,&stats);
+     return stats.collections - collections;
+}
+
+int main(int argc, char** argv) {
+     GarbageCollector gc = gc_create(0,sizeof(struct cell),mark_cell,NULL,NULL);
+     struct gc_stats stats;
+     Cell list = NULL;
+     long i;
+
+     gc_set_growth(gc,0.5,0,0);
+     gc_set_release(gc,1024 * 1024,2);
+     gc_protect(gc,(void**)&list);
+
+     /* a burst of live objects grows the heap to 16 MB */
+     for (i = 0; i < 1000000; i++) {
+          Cell c = gc_alloc(gc);
+          c->next = list;
+          list = c;
+     }
+     list = NULL;
+
+     gc_collect(gc);
+     gc_stats(gc,&stats);
+     ok(stats.heap_bytes >= 1000000 * sizeof(struct cell) && stats.released_bytes == 0,
+        "keeping memory of slabs that were just emptied");
+
+     gc_collect(gc);
+     gc_stats(gc,&stats);
+     ok(stats.released_bytes > 0,"releasing memory of slabs that stay empty");
+     ok(stats.heap_bytes - stats.released_bytes >= 1024 * 1024
+        && stats.heap_bytes - stats.released_bytes < 2 * 1024 * 1024,
+        "keeping the retained size in memory");
+
+     size_t released = stats.released_bytes;
+     for (i = 0; i < 1000000; i++) {
+          Cell c = gc_alloc(gc);
+          c->value = i;
+          c->next = list;
+          list = c;
+     }
+     for (i = 999999; list && list->value == i; list = list->next, i--)
+          ;
+     gc_stats(gc,&stats);
+     ok(i == -1 && stats.released_bytes < released,"reusing released slabs");
+
+     gc_expose(gc,1);
+     gc_free(&gc);
+
+     /* memory released by one size class lets another one grow */
+     gc = gc_create(0,sizeof(struct cell),mark_cell,NULL,NULL);
+     gc_set_growth(gc,0.5,0,0);
+     unsigned long fresh = grow_list(gc);
+     gc_free(&gc);
+
+     gc = gc_create(0,sizeof(struct cell),mark_cell,NULL,NULL);
+     gc_set_growth(gc,0.5,0,0);
+     gc_set_release(gc,1024 * 1024,2);
+     gc_add(gc,1000000);
+     gc_collect(gc);
+     gc_collect(gc);
+     ok(grow_list(gc) <= fresh + 2,"growing into memory released by another size class");
+     gc_free(&gc);
+
+     finish();
+
+     return 0;
+}
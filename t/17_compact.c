@@ -0,0 +1,106 @@
+#include "../gc.h"
+#include "../test.h"
+
+#define NODES 50000
+#define KEEP 10
+
+typedef struct node * Node;
+struct node {
+     Node next;
+     long value;
+};
+
+static void mark_node(void* object) {
+     gc_mark_slot(mark_node,(void**)&((Node)object)->next);
+}
+
+static int collected;
+static void count_collect(void* object) {
+     (void)object;
+     collected++;
+}
+
+/* number of distinct slabs holding the nodes of a list */
+static int count_slabs(Node list) {
+     static size_t seen[NODES];
+     int n = 0, i;
+     for (; list; list = list->next) {
+          size_t slab = (size_t)list & ~((size_t)2 * 1024 * 1024 - 1);
+          for (i = 0; i < n && seen[i] != slab; i++)
+               ;
+          if (i == n)
+               seen[n++] = slab;
+     }
+     return n;
+}
+
+static int in_order(Node list) {
+     long expected = 0;
+     for (; list; list = list->next, expected += KEEP)
+          if (list->value != expected)
+               return 0;
+     return expected == (long)NODES;
+}
+
+int main(int argc, char** argv) {
+     GarbageCollector gc = gc_create_slab(0,sizeof(struct node),4096,mark_node,count_collect,NULL);
+     gc_set_growth(gc,0.5,0,0);
+
+     Node head = NULL, tail = NULL, n;
+     long i;
+     gc_protect(gc,(void**)&head);
+     for (i = 0; i < NODES; i++) {
+          n = gc_alloc(gc);
+          n->next = NULL;
+          n->value = i;
+          if (tail)
+               tail->next = n;
+          else
+               head = n;
+          tail = n;
+     }
+
+     /* drop all but every KEEP-th node, leaving every slab sparse */
+     for (n = head; n; n = n->next) {
+          Node skip = n->next;
+          int j;
+          for (j = 1; skip && j < KEEP; j++)
+               skip = skip->next;
+          n->next = skip;
+     }
+
+     Node pinned = head->next->next, rooted = pinned->next;
+     gc_pin(pinned);
+     gc_root(gc,rooted);
+
+     Node last = head;
+     while (last->next)
+          last = last->next;
+     size_t weak = gc_weak(gc,last,NULL);
+
+     int before = count_slabs(head);
+     gc_compact(gc);
+     int after = count_slabs(head);
+
+     struct gc_stats stats;
+     gc_stats(gc,&stats);
+     ok(stats.moved > 0,"moving objects");
+     ok(after * 2 < before,"packing survivors into fewer slabs");
+     ok(collected == NODES - NODES / KEEP,"collecting dead objects once");
+     ok(in_order(head),"updating references to moved objects");
+     ok(head->next->next == pinned,"keeping pinned objects in place");
+     ok(pinned->next == rooted,"keeping rooted objects in place");
+     for (last = head; last->next; last = last->next)
+          ;
+     ok(gc_weak_key(gc,weak) == last,"updating weak references to moved objects");
+
+     gc_unpin(pinned);
+     gc_collect(gc);
+     ok(in_order(head),"keeping moved objects alive");
+
+     gc_free(&gc);
+
+     finish();
+
+     return 0;
+}
@@ -0,0 +1,67 @@
+#include "../gc.h"
+#include "../test.h"
+
+#define OBJECTS 200
+
+static int collected;
+static void count_collect(void* object) {
+     (void)object;
+     collected++;
+}
+
+static int marked;
+static void count_mark(void* object) {
+     (void)object;
+     marked++;
+}
+
+static int distinct(void** objects, int n) {
+     int i, j;
+     for (i = 0; i < n; i++)
+          for (j = i + 1; j < n; j++)
+               if (objects[i] == objects[j])
+                    return 0;
+     return 1;
+}
+
+int main(int argc, char** argv) {
+     GarbageCollector gc = gc_create(OBJECTS,sizeof(void*),NULL,count_collect,NULL);
+     void* objects[OBJECTS + 50];
+     struct gc_stats stats;
+
+     size_t n = gc_alloc_n(gc,120,objects);
+     ok(n == 120,"allocating all objects requested");
+     ok(distinct(objects,120),"allocating distinct objects");
+
+     gc_protect_frame(gc,objects,120);
+     n = gc_alloc_n(gc,130,objects + 120);
+     gc_stats(gc,&stats);
+     ok(n == OBJECTS - 120,"reporting the number of objects available");
+     ok(stats.collections == 1,"collecting at most once");
+     ok(collected == 0,"keeping objects taken before the collection");
+     ok(distinct(objects,OBJECTS),"never handing out an object twice");
+
+     gc_expose(gc,1);
+     n = gc_alloc_n(gc,50,objects);
+     ok(n == 50,"allocating again after the objects became garbage");
+     ok(collected == OBJECTS,"collecting unreferenced objects");
+
+     ok(gc_alloc_n(gc,0,NULL) == 0,"allocating no objects");
+
+     gc_free(&gc);
+
+     /* the objects taken before a collection are not initialized, so
+        they must survive it without being traced */
+     gc = gc_create(OBJECTS,sizeof(void*),count_mark,count_collect,NULL);
+     gc_set_generational(gc,1);
+     collected = 0;
+     n = gc_alloc_n(gc,OBJECTS + 50,objects);
+     ok(n == OBJECTS,"taking every object before collecting");
+     ok(collected == 0 && marked == 0,"keeping a batch without tracing it");
+
+     gc_free(&gc);
+
+     finish();
+
+     return 0;
+}
@@ -0,0 +1,81 @@
+#include <stddef.h>
+
+#include "../gc.h"
+#include "../test.h"
+
+typedef struct pair * Pair;
+struct pair {
+     long value;
+     Pair car;
+     Pair cdr;
+};
+
+/* object of gc_alloc_size, holding a pair */
+typedef struct box * Box;
+struct box {
+     Pair pair;
+     char padding[40];
+};
+
+static int marked;
+static void mark_box(void* object) {
+     marked++;
+     gc_mark_slot(mark_box,(void**)&((Box)object)->pair);
+}
+
+static int collected;
+static void count_collect(void* object) {
+     (void)object;
+     collected++;
+}
+
+static Pair cons(GarbageCollector gc, Pair car, Pair cdr) {
+     Pair p = gc_alloc(gc);
+     p->value = 0;
+     p->car = car;
+     p->cdr = cdr;
+     return p;
+}
+
+static int count(Pair p) {
+     return p ? 1 + count(p->car) + count(p->cdr) : 0;
+}
+
+int main(int argc, char** argv) {
+     static const size_t offsets[] = { offsetof(struct pair,car), offsetof(struct pair,cdr) };
+     GarbageCollector gc = gc_create(100,sizeof(struct pair),mark_box,count_collect,NULL);
+     gc_set_layout(gc,offsets,2);
+
+     Pair list = NULL;
+     int i;
+     gc_protect(gc,(void**)&list);
+     for (i = 0; i < 20; i++)
+          list = cons(gc,cons(gc,NULL,NULL),list);
+     cons(gc,NULL,NULL); /* garbage */
+
+     gc_collect(gc);
+     ok(count(list) == 40,"tracing references by layout");
+     ok(collected == 1,"collecting objects not referenced");
+     ok(marked == 0,"not calling on_mark for objects with a layout");
+
+     Box box = gc_alloc_size(gc,sizeof(struct box));
+     box->pair = list->car;
+     list->car = NULL;
+     gc_root(gc,box);
+
+     collected = 0;
+     gc_collect(gc);
+     ok(marked == 1,"calling on_mark for objects of gc_alloc_size");
+     ok(collected == 0,"tracing objects with a layout from on_mark");
+
+     static const size_t none[1];
+     gc_set_layout(gc,none,0);
+     gc_collect(gc);
+     ok(collected == 40 - 2,"tracing no references with an empty layout");
+
+     gc_free(&gc);
+
+     finish();
+
+     return 0;
+}
@@ -0,0 +1,99 @@
+#include "../gc.h"
+#include "../test.h"
+
+#define OBJECTS 100
+
+static int collected;
+static void count_collect(void* object) {
+     (void)object;
+     collected++;
+}
+
+static int batches, batched;
+static void count_batch(void** objects, size_t n) {
+     (void)objects;
+     batches++;
+     batched += (int)n;
+}
+
+typedef struct cell * Cell;
+struct cell {
+     Cell next;
+     long value;
+};
+
+static void cell_mark(void* object) {
+     gc_mark_slot(cell_mark,(void**)&((Cell)object)->next);
+}
+
+/* value the referent of the first cell held when it was finalized */
+static Cell first;
+static long seen;
+static void read_next(void* object) {
+     if (object == first)
+          seen = first->next->value;
+}
+
+/* allocate objects until none is left; returns their number */
+static int exhaust(GarbageCollector gc) {
+     int n = 0;
+     while (gc_alloc(gc))
+          n++;
+     return n;
+}
+
+int main(int argc, char** argv) {
+     GarbageCollector gc = gc_create(OBJECTS,sizeof(void*),NULL,count_collect,NULL);
+     gc_set_deferred_finalization(gc,1,0,NULL);
+
+     ok(exhaust(gc) == OBJECTS,"allocating every object");
+     gc_collect(gc);
+     ok(collected == 0,"not finalizing while sweeping");
+     ok(gc_alloc(gc) == NULL,"keeping queued objects until they are finalized");
+
+     ok(gc_run_finalizers(gc,30) == 30,"finalizing a limited number of objects");
+     ok(collected == 30,"calling on_collect for finalized objects");
+     ok(gc_run_finalizers(gc,1000) == OBJECTS - 30,"finalizing all queued objects");
+     ok(exhaust(gc) == OBJECTS,"reusing finalized objects after a collection");
+     ok(collected == OBJECTS,"finalizing each object once");
+
+     gc_set_deferred_finalization(gc,1,0,count_batch);
+     gc_collect(gc);
+     ok(gc_run_finalizers(gc,1000) == OBJECTS,"finalizing in batches");
+     ok(batches == 1 && batched == OBJECTS && collected == OBJECTS,"calling the batch callback instead of on_collect");
+
+     gc_set_deferred_finalization(gc,1,OBJECTS,count_batch);
+     batched = 0;
+     exhaust(gc);
+     ok(batched == OBJECTS,"finalizing when gc_alloc runs out of objects");
+     ok(gc_alloc(gc) != NULL,"reusing objects finalized by gc_alloc");
+
+     gc_collect(gc);
+     gc_set_deferred_finalization(gc,0,0,NULL);
+     ok(collected == OBJECTS + 1,"finalizing queued objects when disabled");
+     gc_collect(gc);
+     ok(collected == OBJECTS + 1,"not finalizing objects twice when disabled");
+
+     gc_free(&gc);
+
+     /* the referent of a queued object is finalized first, collected
+        and its memory offered to gc_alloc before the object itself */
+     gc = gc_create(OBJECTS,sizeof(struct cell),cell_mark,read_next,NULL);
+     gc_set_deferred_finalization(gc,1,0,NULL);
+     first = gc_alloc(gc);
+     first->next = gc_alloc(gc);
+     first->next->value = 42;
+     gc_collect(gc);
+     gc_run_finalizers(gc,1); /* the last queued object, the referent */
+     gc_collect(gc);
+     Cell c;
+     while ((c = gc_alloc(gc)) != NULL)
+          c->value = -1;
+     gc_run_finalizers(gc,1000);
+     ok(seen == 42,"keeping what queued objects reference until they are finalized");
+     gc_free(&gc);
+
+     finish();
+
+     return 0;
+}
@@ -0,0 +1,116 @@
+#include "../gc.h"
+#include "../test.h"
+
+#include <pthread.h>
+
+#define NTHREADS 4
+#define LENGTH 100
+#define ROUNDS 20000
+
+typedef struct cell * Cell;
+struct cell {
+     Cell next;
+     long value;
+};
+
+static void cell_mark(void* object) {
+     gc_mark(cell_mark,((Cell)object)->next);
+}
+
+static int collected;
+static void count_collect(void* object) {
+     (void)object;
+     collected++;
+}
+
+static GarbageCollector gc;
+static int intact[NTHREADS];
+
+/* builds lists referenced by a local variable only */
+static void* worker(void* arg) {
+     long id = (long)arg;
+     Cell head = NULL;
+     long i;
+
+     gc_thread_attach(gc);
+     for (i = 0; i < ROUNDS; i++) {
+          Cell c = gc_alloc(gc);
+          if (!c)
+               break;
+          c->value = id;
+          c->next = head;
+          head = c;
+          if (i % LENGTH == 0) /* drop the list, leaving garbage behind */
+               head->next = NULL;
+     }
+
+     /* the objects reclaimed now are handed out again right away */
+     Cell cur;
+     long n;
+     gc_collect(gc);
+     for (n = 0; n < 2 * LENGTH && (cur = gc_alloc(gc)); n++)
+          cur->value = -1;
+
+     n = 0;
+     intact[id] = i == ROUNDS;
+     for (cur = head; cur; cur = cur->next, n++)
+          if (cur->value != id)
+               intact[id] = 0;
+     if (n != (ROUNDS - 1) % LENGTH + 1)
+          intact[id] = 0;
+
+     gc_thread_detach(gc);
+     return NULL;
+}
+
+/* leaves garbage behind in a frame that is gone once it returns */
+static void make_garbage(GarbageCollector gc, int n) {
+     while (n-- > 0)
+          gc_alloc(gc);
+}
+
+int main(int argc, char** argv) {
+     GarbageCollector local = gc_create(1000,sizeof(struct cell),cell_mark,count_collect,NULL);
+     gc_set_conservative(local,1);
+
+     Cell keep[10];
+     int i;
+     for (i = 0; i < 10; i++) {
+          keep[i] = gc_alloc(local);
+          keep[i]->value = i;
+          keep[i]->next = i ? keep[i - 1] : NULL;
+     }
+     Cell last = gc_alloc(local);
+     last->value = 10;
+     long* inside = &last->value; /* may be all that is left of last */
+     last = NULL;
+     gc_collect(local);
+     ok(collected == 0,"keeping objects referenced from the stack");
+     for (i = 0; i < 10 && keep[i]->value == i; i++)
+          ;
+     ok(i == 10 && *inside == 10,"leaving referenced objects intact");
+
+     make_garbage(local,500);
+     gc_collect(local);
+     ok(collected > 450,"collecting objects no longer on the stack");
+     gc_free(&local);
+
+     pthread_t threads[NTHREADS];
+     long t;
+     gc = gc_create_slab(NTHREADS * 4 * LENGTH,sizeof(struct cell),4096,cell_mark,NULL,NULL);
+     gc_set_threaded(gc);
+     gc_set_conservative(gc,1);
+     gc_thread_detach(gc); /* not allocating while waiting for the workers */
+     for (t = 0; t < NTHREADS; t++)
+          pthread_create(&threads[t],NULL,worker,(void*)t);
+     for (t = 0; t < NTHREADS; t++)
+          pthread_join(threads[t],NULL);
+     for (t = 0; t < NTHREADS && intact[t]; t++)
+          ;
+     ok(t == NTHREADS,"scanning the stacks of all threads");
+     gc_free(&gc);
+
+     finish();
+
+     return 0;
+}
@@ -0,0 +1,66 @@
+#include "../gc.h"
+#include "../test.h"
+
+typedef struct pair * Pair;
+struct pair {
+     Pair car;
+     Pair cdr;
+};
+
+static void mark_pair(void* object) {
+     gc_mark_slot(mark_pair,(void**)&((Pair)object)->car);
+     gc_mark_slot(mark_pair,(void**)&((Pair)object)->cdr);
+}
+
+static int collected;
+static void count_collect(void* object) {
+     (void)object;
+     collected++;
+}
+
+static Pair cons(GarbageCollector gc, Pair car, Pair cdr) {
+     Pair p = gc_alloc(gc);
+     p->car = car;
+     p->cdr = cdr;
+     return p;
+}
+
+int main(int argc, char** argv) {
+     GarbageCollector gc = gc_create(100,sizeof(struct pair),mark_pair,count_collect,NULL);
+
+     Pair kept = cons(gc,NULL,NULL);
+     gc_protect(gc,(void**)&kept);
+     size_t alive = gc_weak(gc,kept,NULL);
+     size_t dead = gc_weak(gc,cons(gc,NULL,NULL),NULL);
+     gc_collect(gc);
+     ok(gc_weak_key(gc,alive) == kept,"keeping weak references to live objects");
+     ok(gc_weak_key(gc,dead) == NULL && collected == 1,"clearing weak references to dead objects");
+
+     /* the value of the second entry is only reachable through the
+        key of the first, which is checked later */
+     Pair key2 = cons(gc,NULL,NULL);
+     size_t second = gc_weak(gc,key2,cons(gc,NULL,NULL));
+     size_t first = gc_weak(gc,kept,cons(gc,key2,NULL));
+     key2 = NULL;
+     collected = 0;
+     gc_collect(gc);
+     ok(gc_weak_value(gc,first) != NULL && gc_weak_value(gc,second) != NULL,"keeping values of live keys");
+     ok(collected == 0,"tracing values until no more keys are reached");
+
+     /* a value referencing its own key does not keep it alive */
+     Pair key3 = cons(gc,NULL,NULL);
+     size_t cycle = gc_weak(gc,key3,cons(gc,key3,NULL));
+     key3 = NULL;
+     gc_weak_free(gc,first);
+     collected = 0;
+     gc_collect(gc);
+     ok(gc_weak_key(gc,cycle) == NULL && gc_weak_value(gc,cycle) == NULL,"clearing entries of dead keys");
+     ok(collected == 5,"collecting values with their keys");
+     ok(gc_weak(gc,kept,NULL) == first,"reusing freed handles");
+
+     gc_free(&gc);
+
+     finish();
+
+     return 0;
+}
@@ -0,0 +1,118 @@
+#include <stddef.h>
+#include <errno.h>
+#include <stdio.h>
+
+#include "../gc.h"
+#include "../test.h"
+
+#define PAIRS 10000
+#define IMAGE "t/23_image.img"
+
+typedef struct pair * Pair;
+struct pair {
+     long value;
+     Pair car;
+     Pair cdr;
+};
+
+static void mark_by_value(void* object) {
+     gc_mark(mark_by_value,((Pair)object)->cdr);
+}
+
+static int collected;
+static void count_collect(void* object) {
+     (void)object;
+     collected++;
+}
+
+static GarbageCollector create(void) {
+     static const size_t offsets[] = { offsetof(struct pair,car), offsetof(struct pair,cdr) };
+     GarbageCollector gc = gc_create(100,sizeof(struct pair),NULL,count_collect,NULL);
+     gc_set_growth(gc,0.5,0,0);
+     gc_set_layout(gc,offsets,2);
+     return gc;
+}
+
+/* a list of PAIRS pairs, the car of each holding its value again */
+static Pair build(GarbageCollector gc) {
+     Pair list = NULL;
+     long i;
+     gc_protect(gc,(void**)&list);
+     for (i = 0; i < PAIRS; i++) {
+          Pair value = gc_alloc(gc);
+          value->value = i;
+          value->car = value->cdr = NULL;
+          gc_protect(gc,(void**)&value);
+          Pair p = gc_alloc(gc);
+          gc_expose(gc,1);
+          p->value = i;
+          p->car = value;
+          p->cdr = list;
+          list = p;
+          gc_alloc(gc); /* garbage, left out of the image */
+     }
+     gc_expose(gc,1);
+     return list;
+}
+
+static int intact(Pair list) {
+     long expected = PAIRS;
+     for (; list; list = list->cdr)
+          if (list->value != --expected || list->car->value != expected)
+               return 0;
+     return expected == 0;
+}
+
+int main(int argc, char** argv) {
+     GarbageCollector gc = create(), other = create();
+     Pair list = build(gc);
+     gc_root(gc,list);
+     gc_collect(gc);
+     ok(gc_save_image(gc,IMAGE,list) == 0,"saving a heap image");
+     ok(intact(list),"leaving the saved heap intact");
+
+     Pair copy = gc_load_image(gc,IMAGE);
+     ok(copy && copy != list && intact(copy),"relocating an image mapped elsewhere");
+     collected = 0;
+     gc_collect(gc);
+     ok(collected == 2 * PAIRS,"collecting unreferenced loaded objects");
+     ok(intact(list),"keeping the original objects");
+
+     Pair saved = list;
+     gc_free(&gc);
+     Pair loaded = gc_load_image(other,IMAGE);
+     gc_root(other,loaded);
+     ok(loaded == saved,"mapping an image at the address it was saved from");
+     ok(loaded && intact(loaded),"loading objects unchanged");
+     gc_collect(other);
+     ok(intact(loaded),"keeping loaded objects that are reachable");
+     Pair p = gc_alloc(other);
+     p->car = p->cdr = NULL;
+     p->value = PAIRS;
+     loaded->car = p;
+     gc_unroot(other,loaded);
+     collected = 0;
+     gc_collect(other);
+     ok(collected == 2 * PAIRS + 1,"collecting loaded objects");
+
+     GarbageCollector small = gc_create(100,sizeof(void*),NULL,NULL,NULL);
+     errno = 0;
+     ok(gc_load_image(small,IMAGE) == NULL && errno == EINVAL,"rejecting images of other object sizes");
+     gc_free(&small);
+     ok(gc_load_image(other,"t/23_image.none") == NULL,"failing for missing images");
+
+     GarbageCollector by_value = gc_create(100,sizeof(struct pair),mark_by_value,NULL,NULL);
+     Pair a = gc_alloc(by_value), b = gc_alloc(by_value);
+     a->cdr = b;
+     b->cdr = NULL;
+     errno = 0;
+     ok(gc_save_image(by_value,IMAGE,a) == -1 && errno == EINVAL,"refusing references marked by value");
+     gc_free(&by_value);
+
+     gc_free(&other);
+     remove(IMAGE);
+
+     finish();
+
+     return 0;
+}
@@ -0,0 +1,78 @@
+#include "../gc.h"
+#include "../test.h"
+
+#define OBJECTS 100000
+#define SLAB ((size_t)2 * 1024 * 1024)
+
+typedef struct cell * Cell;
+struct cell {
+     Cell next;
+     long value;
+};
+
+static void mark_cell(void* object) {
+     gc_mark_slot(mark_cell,(void**)&((Cell)object)->next);
+}
+
+/* fill the heap with a list of OBJECTS cells and collect it */
+static int use(GarbageCollector gc) {
+     Cell list = NULL, c;
+     long i;
+     gc_protect(gc,(void**)&list);
+     for (i = 0; i < OBJECTS && (c = gc_alloc(gc)); i++) {
+          c->value = i;
+          c->next = list;
+          list = c;
+     }
+     gc_collect(gc);
+     for (c = list; c && c->value == --i; c = c->next)
+          ;
+     gc_expose(gc,1);
+     return i == 0 && !c;
+}
+
+int main(int argc, char** argv) {
+     struct gc_stats stats;
+     size_t before, added;
+
+     GarbageCollector gc = gc_create(1000,sizeof(struct cell),mark_cell,NULL,NULL);
+     gc_stats(gc,&stats);
+     ok(stats.huge_bytes == 0 && stats.transparent_bytes == 0 && stats.bound_bytes == 0,
+        "using ordinary pages by default");
+
+     before = stats.heap_bytes;
+     gc_set_backing(gc,GC_PAGES_HUGE,0);
+     gc_add(gc,OBJECTS);
+     gc_stats(gc,&stats);
+     added = stats.heap_bytes - before;
+     ok(added > 0 && added % SLAB == 0,"mapping whole huge pages");
+     ok(stats.huge_bytes + stats.transparent_bytes == added
+        || stats.huge_bytes + stats.transparent_bytes == 0,
+        "reporting huge pages of new slabs");
+     ok(stats.bound_bytes == added || stats.bound_bytes == 0,"reporting slabs bound to a node");
+     ok(use(gc),"using objects in huge pages");
+     gc_free(&gc);
+
+     gc = gc_create(0,sizeof(struct cell),mark_cell,NULL,NULL);
+     gc_set_backing(gc,GC_PAGES_DEFAULT,GC_NODE_INTERLEAVE);
+     gc_add(gc,OBJECTS);
+     ok(use(gc),"using objects interleaved across nodes");
+     void* large = gc_alloc_size(gc,100000);
+     gc_stats(gc,&stats);
+     ok(large && stats.huge_bytes == 0 && stats.transparent_bytes == 0,"using ordinary pages when asked to");
+     gc_free(&gc);
+
+     gc = gc_create_slab(0,sizeof(struct cell),4096,mark_cell,NULL,NULL);
+     gc_set_backing(gc,GC_PAGES_TRANSPARENT,GC_NODE_LOCAL);
+     gc_set_backing(gc,GC_PAGES_DEFAULT,GC_NODE_LOCAL);
+     gc_stats(gc,&stats);
+     before = stats.heap_bytes;
+     gc_add(gc,1);
+     gc_stats(gc,&stats);
+     ok(stats.heap_bytes - before == 4096,"returning to the slab size chosen at creation");
+     gc_free(&gc);
+
+     finish();
+
+     return 0;
+}
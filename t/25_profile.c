@@ -0,0 +1,88 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../gc.h"
+#include "../test.h"
+
+#define OBJECTS 100000
+#define SAMPLE 4096
+
+typedef struct node * Node;
+struct node {
+     Node next;
+     long values[3];
+};
+
+/* total bytes of a profile and its number of stacks */
+static unsigned long long profile_bytes(GarbageCollector gc, int kind, int* stacks) {
+     FILE* f = tmpfile();
+     char line[16384];
+     unsigned long long total = 0, bytes;
+     gc_write_profile(gc,f,kind);
+     rewind(f);
+     *stacks = 0;
+     while (fgets(line,sizeof line,f)) {
+          char* space = strrchr(line,' ');
+          if (space && sscanf(space,"%llu",&bytes) == 1) {
+               total += bytes;
+               ++*stacks;
+          }
+     }
+     fclose(f);
+     return total;
+}
+
+static int near(unsigned long long bytes, unsigned long long expected) {
+     return bytes > expected * 4 / 5 && bytes < expected * 6 / 5;
+}
+
+static Node keep(GarbageCollector gc, Node list) {
+     Node n = gc_alloc(gc);
+     n->next = list;
+     return n;
+}
+
+static void drop(GarbageCollector gc) {
+     void* objects[10];
+     gc_alloc_n(gc,10,objects);
+}
+
+int main(int argc, char** argv) {
+     static const size_t offsets[] = { offsetof(struct node,next) };
+     GarbageCollector gc = gc_create(1000,sizeof(struct node),NULL,NULL,NULL);
+     gc_set_growth(gc,0.5,0,0);
+     gc_set_layout(gc,offsets,1);
+     int stacks, i;
+
+     gc_set_profiling(gc,SAMPLE);
+     Node list = NULL;
+     gc_protect(gc,(void**)&list);
+     for (i = 0; i < OBJECTS; i++) {
+          list = keep(gc,list);
+          if (i % 10 == 0)
+               drop(gc);
+     }
+
+     unsigned long long kept = (unsigned long long)OBJECTS * sizeof(struct node);
+     ok(near(profile_bytes(gc,GC_PROFILE_ALLOCATED,&stacks),2 * kept),"estimating the bytes allocated");
+     ok(stacks >= 2,"telling allocation sites apart");
+
+     gc_collect(gc);
+     ok(near(profile_bytes(gc,GC_PROFILE_LIVE,&stacks),kept),"estimating the bytes still alive");
+     gc_expose(gc,1);
+     gc_collect(gc);
+     ok(profile_bytes(gc,GC_PROFILE_LIVE,&stacks) == 0 && stacks == 0,"forgetting dead objects");
+     ok(near(profile_bytes(gc,GC_PROFILE_ALLOCATED,&stacks),2 * kept),"keeping the bytes allocated");
+
+     gc_set_profiling(gc,0);
+     for (i = 0; i < 1000; i++)
+          gc_alloc(gc);
+     ok(profile_bytes(gc,GC_PROFILE_ALLOCATED,&stacks) == 0,"sampling nothing while disabled");
+
+     gc_free(&gc);
+
+     finish();
+
+     return 0;
+}